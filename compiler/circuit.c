@@ -1,6 +1,15 @@
 #include "circuit.h"
+#include <stdarg.h>
 
-Circuit circuit;
+__thread Circuit circuit;
+__thread FILE *circuit_log;
+
+void log_printf(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    vfprintf(circuit_log ? circuit_log : stdout, format, args);
+    va_end(args);
+}
 
 void init_intlist(IntList *list) {
     list->items = NULL;
@@ -28,17 +37,293 @@ void free_intlist(IntList *list) {
     list->capacity = 0;
 }
 
+void init_symbollist(SymbolList *list) {
+    list->items = NULL;
+    list->count = 0;
+    list->capacity = 0;
+}
+
+void add_to_symbollist(SymbolList *list, Symbol value) {
+    if (list->count >= list->capacity) {
+        list->capacity = (list->capacity == 0) ? 16 : list->capacity * 2;
+        list->items = (Symbol *)realloc(list->items, list->capacity * sizeof(Symbol));
+        if (!list->items) {
+            exit(1);
+        }
+    }
+    list->items[list->count++] = value;
+}
+
+void free_symbollist(SymbolList *list) {
+    if (list->items) {
+        free(list->items);
+        list->items = NULL;
+    }
+    list->count = 0;
+    list->capacity = 0;
+}
+
+static void init_adjacency(Adjacency *adj) {
+    adj->start = NULL;
+    adj->count = NULL;
+    adj->capacity = NULL;
+    adj->edges = NULL;
+    adj->edge_used = 0;
+    adj->edge_capacity = 0;
+}
+
+static void free_adjacency(Adjacency *adj) {
+    if (adj->start) free(adj->start);
+    if (adj->count) free(adj->count);
+    if (adj->capacity) free(adj->capacity);
+    if (adj->edges) free(adj->edges);
+    init_adjacency(adj);
+}
+
+// resizes the per-gate arrays to follow circuit.gate_capacity
+static void resize_adjacency(Adjacency *adj, int gate_capacity) {
+    adj->start = (int *)realloc(adj->start, gate_capacity * sizeof(int));
+    adj->count = (int *)realloc(adj->count, gate_capacity * sizeof(int));
+    adj->capacity = (int *)realloc(adj->capacity, gate_capacity * sizeof(int));
+    if (!adj->start || !adj->count || !adj->capacity) {
+        exit(1);
+    }
+}
+
+// hands out size contiguous slots at the end of the edge array
+static int reserve_edges(Adjacency *adj, int size) {
+    if (adj->edge_used + size > adj->edge_capacity) {
+        while (adj->edge_used + size > adj->edge_capacity) {
+            adj->edge_capacity = (adj->edge_capacity == 0) ? 1024 : adj->edge_capacity * 2;
+        }
+        adj->edges = (int *)realloc(adj->edges, adj->edge_capacity * sizeof(int));
+        if (!adj->edges) {
+            exit(1);
+        }
+    }
+    int start = adj->edge_used;
+    adj->edge_used += size;
+    return start;
+}
+
+static void append_edge(Adjacency *adj, int id, int value) {
+    if (adj->count[id] == adj->capacity[id]) {
+        // full segment: move it to the end with twice the room
+        int capacity = (adj->capacity[id] == 0) ? 2 : adj->capacity[id] * 2;
+        int start = reserve_edges(adj, capacity);
+        memcpy(&adj->edges[start], &adj->edges[adj->start[id]], adj->count[id] * sizeof(int));
+        adj->start[id] = start;
+        adj->capacity[id] = capacity;
+    }
+    adj->edges[adj->start[id] + adj->count[id]++] = value;
+}
+
+// removes the first occurrence of value, keeping the order of the rest
+static void remove_edge(Adjacency *adj, int id, int value) {
+    int *items = &adj->edges[adj->start[id]];
+    for (int i = 0; i < adj->count[id]; i++) {
+        if (items[i] == value) {
+            memmove(&items[i], &items[i + 1], (adj->count[id] - i - 1) * sizeof(int));
+            adj->count[id]--;
+            return;
+        }
+    }
+}
+
+// packs every gate's segment back to back, in gate order, with no slack
+static void compact_adjacency(Adjacency *adj, int gate_count) {
+    int total = 0;
+    for (int i = 0; i < gate_count; i++) {
+        total += adj->count[i];
+    }
+
+    int *edges = (int *)malloc((total > 0 ? total : 1) * sizeof(int));
+    if (!edges) {
+        exit(1);
+    }
+
+    int pos = 0;
+    for (int i = 0; i < gate_count; i++) {
+        memcpy(&edges[pos], &adj->edges[adj->start[i]], adj->count[i] * sizeof(int));
+        adj->start[i] = pos;
+        adj->capacity[i] = adj->count[i];
+        pos += adj->count[i];
+    }
+
+    if (adj->edges) {
+        free(adj->edges);
+    }
+    adj->edges = edges;
+    adj->edge_used = total;
+    adj->edge_capacity = (total > 0) ? total : 1;
+}
+
+// FNV-1a hash over len bytes
+static unsigned int hash_bytes(const char *s, int len) {
+    unsigned int h = 2166136261u;
+    for (int i = 0; i < len; i++) {
+        h ^= (unsigned char)s[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static void init_arena(StringArena *arena) {
+    arena->data = NULL;
+    arena->used = 0;
+    arena->capacity = 0;
+    arena->offsets = NULL;
+    arena->hashes = NULL;
+    arena->count = 0;
+    arena->symbol_capacity = 0;
+    arena->slots = NULL;
+    arena->slot_capacity = 0;
+}
+
+static void free_arena(StringArena *arena) {
+    if (arena->data) free(arena->data);
+    if (arena->offsets) free(arena->offsets);
+    if (arena->hashes) free(arena->hashes);
+    if (arena->slots) free(arena->slots);
+    init_arena(arena);
+}
+
+static void grow_slots(StringArena *arena) {
+    arena->slot_capacity = (arena->slot_capacity == 0) ? 1024 : arena->slot_capacity * 2;
+    arena->slots = (Symbol *)realloc(arena->slots, arena->slot_capacity * sizeof(Symbol));
+    if (!arena->slots) {
+        exit(1);
+    }
+
+    // rebuild from the cached hashes, symbols are known to be distinct
+    unsigned int mask = arena->slot_capacity - 1;
+    for (int i = 0; i < arena->slot_capacity; i++) {
+        arena->slots[i] = NO_SYMBOL;
+    }
+    for (int sym = 0; sym < arena->count; sym++) {
+        unsigned int pos = arena->hashes[sym] & mask;
+        while (arena->slots[pos] != NO_SYMBOL) {
+            pos = (pos + 1) & mask;
+        }
+        arena->slots[pos] = sym;
+    }
+}
+
+// returns the slot holding s, or the empty slot where it belongs
+static unsigned int probe_arena(const StringArena *arena, const char *s, int len, unsigned int hash) {
+    unsigned int mask = arena->slot_capacity - 1;
+    unsigned int pos = hash & mask;
+    while (arena->slots[pos] != NO_SYMBOL) {
+        Symbol sym = arena->slots[pos];
+        const char *str = arena->data + arena->offsets[sym];
+        if (arena->hashes[sym] == hash && strncmp(str, s, len) == 0 && str[len] == '\0') {
+            break;
+        }
+        pos = (pos + 1) & mask;
+    }
+    return pos;
+}
+
+Symbol intern_string(const char *s, int len) {
+    StringArena *arena = &circuit.strings;
+
+    // keep the load factor under 1/2 so probe chains stay short
+    if ((arena->count + 1) * 2 > arena->slot_capacity) {
+        grow_slots(arena);
+    }
+
+    unsigned int hash = hash_bytes(s, len);
+    unsigned int pos = probe_arena(arena, s, len, hash);
+    if (arena->slots[pos] != NO_SYMBOL) {
+        return arena->slots[pos];
+    }
+
+    if (arena->used + len + 1 > arena->capacity) {
+        while (arena->used + len + 1 > arena->capacity) {
+            arena->capacity = (arena->capacity == 0) ? 65536 : arena->capacity * 2;
+        }
+        arena->data = (char *)realloc(arena->data, arena->capacity);
+        if (!arena->data) {
+            exit(1);
+        }
+    }
+
+    if (arena->count >= arena->symbol_capacity) {
+        arena->symbol_capacity = (arena->symbol_capacity == 0) ? 1024 : arena->symbol_capacity * 2;
+        arena->offsets = (unsigned int *)realloc(arena->offsets, arena->symbol_capacity * sizeof(unsigned int));
+        arena->hashes = (unsigned int *)realloc(arena->hashes, arena->symbol_capacity * sizeof(unsigned int));
+        if (!arena->offsets || !arena->hashes) {
+            exit(1);
+        }
+    }
+
+    Symbol sym = arena->count++;
+    arena->offsets[sym] = (unsigned int)arena->used;
+    arena->hashes[sym] = hash;
+    memcpy(arena->data + arena->used, s, len);
+    arena->data[arena->used + len] = '\0';
+    arena->used += len + 1;
+    arena->slots[pos] = sym;
+    return sym;
+}
+
+Symbol find_symbol(const char *s) {
+    const StringArena *arena = &circuit.strings;
+    if (arena->slot_capacity == 0) {
+        return NO_SYMBOL;
+    }
+    int len = strlen(s);
+    return arena->slots[probe_arena(arena, s, len, hash_bytes(s, len))];
+}
+
+// the pointer is only valid until the next intern_string call
+const char *symbol_name(Symbol sym) {
+    return circuit.strings.data + circuit.strings.offsets[sym];
+}
+
+// grow the symbol -> gate maps so that sym is a valid index
+static void reserve_symbol_maps(Symbol sym) {
+    if (sym < (Symbol)circuit.map_capacity) {
+        return;
+    }
+
+    int old_capacity = circuit.map_capacity;
+    while (sym >= (Symbol)circuit.map_capacity) {
+        circuit.map_capacity = (circuit.map_capacity == 0) ? 1024 : circuit.map_capacity * 2;
+    }
+    circuit.gate_by_name = (int *)realloc(circuit.gate_by_name, circuit.map_capacity * sizeof(int));
+    circuit.driver_by_wire = (int *)realloc(circuit.driver_by_wire, circuit.map_capacity * sizeof(int));
+    if (!circuit.gate_by_name || !circuit.driver_by_wire) {
+        exit(1);
+    }
+    for (int i = old_capacity; i < circuit.map_capacity; i++) {
+        circuit.gate_by_name[i] = -1;
+        circuit.driver_by_wire[i] = -1;
+    }
+}
+
 void init_circuit(void) {
     circuit.gates = NULL;
     circuit.gate_count = 0;
     circuit.gate_capacity = 0;
+    init_adjacency(&circuit.fanins);
+    init_adjacency(&circuit.fanouts);
     circuit.input_count = 0;
     circuit.output_count = 0;
     circuit.dff_count = 0;
+    init_arena(&circuit.strings);
+    circuit.gate_by_name = NULL;
+    circuit.driver_by_wire = NULL;
+    circuit.map_capacity = 0;
+    circuit.max_level = 0;
+    circuit.level_counts = NULL;
+    circuit.level_capacity = 0;
+    circuit.pending = NULL;
+    circuit.pending_capacity = 0;
 }
 
-void add_gate(const char *name, GateType type) {
-    if (!name) {
+void add_gate(Symbol name, GateType type) {
+    if (name == NO_SYMBOL) {
         return;
     }
     int idx = find_gate_by_name(name);
@@ -52,21 +337,23 @@ void add_gate(const char *name, GateType type) {
         if (!circuit.gates) {
             exit(1);
         }
+        resize_adjacency(&circuit.fanins, circuit.gate_capacity);
+        resize_adjacency(&circuit.fanouts, circuit.gate_capacity);
     }
 
     Gate *g = &circuit.gates[circuit.gate_count];
     g->id = circuit.gate_count;
-    g->name = strdup(name);
-    g->output_wire = NULL;
-
-    if (!g->name) {
-        exit(1);
-    }
+    g->name = name;
+    g->output_wire = NO_SYMBOL;
     g->type = type;
     g->is_output = 0;
     g->level = -1; 
-    init_intlist(&g->fanins);
-    init_intlist(&g->fanouts);
+    circuit.fanins.start[g->id] = 0;
+    circuit.fanins.count[g->id] = 0;
+    circuit.fanins.capacity[g->id] = 0;
+    circuit.fanouts.start[g->id] = 0;
+    circuit.fanouts.count[g->id] = 0;
+    circuit.fanouts.capacity[g->id] = 0;
 
     if (type == GATE_INPUT) {
         circuit.input_count++;
@@ -75,29 +362,42 @@ void add_gate(const char *name, GateType type) {
         circuit.dff_count++;
         g->level = 0; 
     }
+    reserve_symbol_maps(name);
+    circuit.gate_by_name[name] = g->id;
     circuit.gate_count++;
 }
 
-int find_gate_by_name(const char *name) {
-    for (int i = 0; i < circuit.gate_count; i++) {
-        if (strcmp(circuit.gates[i].name, name) == 0) {
-            return i;
-        }
+int find_gate_by_name(Symbol name) {
+    // NO_SYMBOL is the largest handle, so it always falls outside the map
+    if (name >= (Symbol)circuit.map_capacity) {
+        return -1;
     }
-    return -1;
+    return circuit.gate_by_name[name];
 }
 
-int find_gate_by_output_wire(const char *wire_name) {
-    for (int i = 0; i < circuit.gate_count; i++) {
-        if (circuit.gates[i].output_wire && 
-            strcmp(circuit.gates[i].output_wire, wire_name) == 0) {
-            return i;
-        }
+int find_gate_by_output_wire(Symbol wire_name) {
+    if (wire_name >= (Symbol)circuit.map_capacity) {
+        return -1;
+    }
+    return circuit.driver_by_wire[wire_name];
+}
+
+// a gate drives exactly one wire; when several gates claim the same wire
+// the first one keeps it as the driver
+void set_gate_output_wire(int gate_id, Symbol wire_name) {
+    Gate *g = &circuit.gates[gate_id];
+    if (g->output_wire != NO_SYMBOL) {
+        return;
+    }
+
+    g->output_wire = wire_name;
+    reserve_symbol_maps(wire_name);
+    if (circuit.driver_by_wire[wire_name] < 0) {
+        circuit.driver_by_wire[wire_name] = gate_id;
     }
-    return -1;
 }
 
-void add_connection(const char *from_wire, const char *to_wire) {
+void add_connection(Symbol from_wire, Symbol to_wire) {
     int from_id = find_gate_by_output_wire(from_wire);
     
     int to_id = find_gate_by_output_wire(to_wire);
@@ -107,15 +407,32 @@ void add_connection(const char *from_wire, const char *to_wire) {
     }
     
     if (from_id < 0 || to_id < 0) {
-        fprintf(stderr, "Warning: Connection failed %s -> %s\n", from_wire, to_wire);
+        fprintf(stderr, "Warning: Connection failed %s -> %s\n",
+                symbol_name(from_wire), symbol_name(to_wire));
         return;
     }
     
-    add_to_intlist(&circuit.gates[from_id].fanouts, to_id);
-    add_to_intlist(&circuit.gates[to_id].fanins, from_id);
+    connect_gates(from_id, to_id);
 }
 
-void set_gate_as_output(const char *name) {
+void connect_gates(int from_id, int to_id) {
+    append_edge(&circuit.fanouts, from_id, to_id);
+    append_edge(&circuit.fanins, to_id, from_id);
+}
+
+void disconnect_gates(int from_id, int to_id) {
+    remove_edge(&circuit.fanouts, from_id, to_id);
+    remove_edge(&circuit.fanins, to_id, from_id);
+}
+
+// packs the adjacency into plain CSR once a batch of edits (parsing, buffer
+// insertion) is done, so the graph passes walk contiguous memory
+void build_csr(void) {
+    compact_adjacency(&circuit.fanins, circuit.gate_count);
+    compact_adjacency(&circuit.fanouts, circuit.gate_count);
+}
+
+void set_gate_as_output(Symbol name) {
     int idx = find_gate_by_name(name);
     
     if (idx < 0) {
@@ -129,134 +446,313 @@ void set_gate_as_output(const char *name) {
     }
 }
 
+// Kahn-style levelization: a gate is levelized once all of its fanins are,
+// so every gate and edge is visited once. Inputs and DFFs are the level-0
+// sources (DFF D inputs are not followed); gates with no fanins or that sit
+// on a combinational loop are left at -1. Also builds the level histogram.
 void assign_levels(void) {
-    int changed = 1;
-    int iteration = 0;
-    
-    while (changed) {
-        changed = 0;
-        iteration++;
-        
-        for (int i = 0; i < circuit.gate_count; i++) {
-            Gate *g = &circuit.gates[i];
-            
-            if (g->level == 0) continue;
-
-            int can_assign = 1;
-            int max_level = -1;
-            
-            for (int j = 0; j < g->fanins.count; j++) {
-                int fanin_id = g->fanins.items[j];
-                int fanin_level = circuit.gates[fanin_id].level;
-                
-                if (fanin_level < 0) {
-                    can_assign = 0;
-                    break;
-                }
-                
-                if (fanin_level > max_level) {
-                    max_level = fanin_level;
-                }
+    int n = circuit.gate_count;
+    int *pending = (int *)malloc((n + 1) * sizeof(int));
+    int *queue = (int *)malloc((n + 1) * sizeof(int));
+    if (!pending || !queue) {
+        exit(1);
+    }
+
+    int head = 0, tail = 0;
+    for (int i = 0; i < n; i++) {
+        Gate *g = &circuit.gates[i];
+        if (g->type == GATE_INPUT || g->type == GATE_DFF) {
+            g->level = 0;
+            pending[i] = 0;
+            queue[tail++] = i;
+        } else {
+            g->level = -1;
+            pending[i] = gate_fanin_count(i);
+        }
+    }
+
+    while (head < tail) {
+        int id = queue[head++];
+        Gate *g = &circuit.gates[id];
+        const int *fanouts = gate_fanouts(id);
+        int fanout_count = gate_fanout_count(id);
+
+        for (int j = 0; j < fanout_count; j++) {
+            int fanout_id = fanouts[j];
+            Gate *fanout = &circuit.gates[fanout_id];
+            if (fanout->type == GATE_INPUT || fanout->type == GATE_DFF) {
+                continue;
             }
-            
-            if (can_assign && max_level >= 0) {
-                int new_level = max_level + 1;
-                if (g->level != new_level) {
-                    g->level = new_level;
-                    changed = 1;
-                }
+
+            if (g->level + 1 > fanout->level) {
+                fanout->level = g->level + 1;
+            }
+            if (--pending[fanout_id] == 0) {
+                queue[tail++] = fanout_id;
+            }
+        }
+    }
+
+    // gates never released sit on or behind a combinational loop; drop the
+    // partial level their levelized fanins gave them
+    for (int i = 0; i < n; i++) {
+        if (pending[i] > 0) {
+            circuit.gates[i].level = -1;
+        }
+    }
+
+    free(pending);
+    free(queue);
+
+    circuit.max_level = 0;
+    for (int i = 0; i < n; i++) {
+        if (circuit.gates[i].level > circuit.max_level) {
+            circuit.max_level = circuit.gates[i].level;
+        }
+    }
+
+    circuit.level_capacity = circuit.max_level + 1;
+    circuit.level_counts = (int *)realloc(circuit.level_counts, circuit.level_capacity * sizeof(int));
+    if (!circuit.level_counts) {
+        exit(1);
+    }
+    memset(circuit.level_counts, 0, circuit.level_capacity * sizeof(int));
+    for (int i = 0; i < n; i++) {
+        if (circuit.gates[i].level >= 0) {
+            circuit.level_counts[circuit.gates[i].level]++;
+        }
+    }
+}
+
+// moves a gate to a new level, keeping level_counts and max_level in sync
+static void set_gate_level(Gate *g, int level) {
+    if (g->level == level) {
+        return;
+    }
+
+    if (g->level >= 0) {
+        circuit.level_counts[g->level]--;
+    }
+    if (level >= circuit.level_capacity) {
+        int old_capacity = circuit.level_capacity;
+        while (level >= circuit.level_capacity) {
+            circuit.level_capacity = (circuit.level_capacity == 0) ? 16 : circuit.level_capacity * 2;
+        }
+        circuit.level_counts = (int *)realloc(circuit.level_counts, circuit.level_capacity * sizeof(int));
+        if (!circuit.level_counts) {
+            exit(1);
+        }
+        memset(&circuit.level_counts[old_capacity], 0, (circuit.level_capacity - old_capacity) * sizeof(int));
+    }
+    if (level >= 0) {
+        circuit.level_counts[level]++;
+    }
+    g->level = level;
+
+    if (level > circuit.max_level) {
+        circuit.max_level = level;
+    }
+    while (circuit.max_level > 0 && circuit.level_counts[circuit.max_level] == 0) {
+        circuit.max_level--;
+    }
+}
+
+// Re-levelizes after connections were added or removed, assuming levels were
+// valid before the edits. Only the forward cone of the edited gates is
+// visited: the cone is levelized with the same pending-fanin worklist as
+// assign_levels, treating levels outside it as fixed.
+void update_levels(const Connection *edits, int edit_count) {
+    int n = circuit.gate_count;
+
+    // pending[i] is -1 for gates outside the cone, and is kept that way
+    // between calls so that nothing here is O(N)
+    if (n > circuit.pending_capacity) {
+        int old_capacity = circuit.pending_capacity;
+        circuit.pending_capacity = (n > old_capacity * 2) ? n : old_capacity * 2;
+        circuit.pending = (int *)realloc(circuit.pending, circuit.pending_capacity * sizeof(int));
+        if (!circuit.pending) {
+            exit(1);
+        }
+        for (int i = old_capacity; i < circuit.pending_capacity; i++) {
+            circuit.pending[i] = -1;
+        }
+    }
+    int *pending = circuit.pending;
+
+    // collect the forward cone of every gate whose fanins changed
+    IntList cone;
+    init_intlist(&cone);
+    for (int e = 0; e < edit_count; e++) {
+        int to_id = edits[e].to;
+        GateType type = circuit.gates[to_id].type;
+        if (pending[to_id] < 0 && type != GATE_INPUT && type != GATE_DFF) {
+            pending[to_id] = 0;
+            add_to_intlist(&cone, to_id);
+        }
+    }
+    for (int c = 0; c < cone.count; c++) {
+        const int *fanouts = gate_fanouts(cone.items[c]);
+        int fanout_count = gate_fanout_count(cone.items[c]);
+        for (int j = 0; j < fanout_count; j++) {
+            int fanout_id = fanouts[j];
+            GateType type = circuit.gates[fanout_id].type;
+            if (type == GATE_INPUT || type == GATE_DFF) {
+                continue;
+            }
+            if (pending[fanout_id] < 0) {
+                pending[fanout_id] = 0;
+                add_to_intlist(&cone, fanout_id);
+            }
+            pending[fanout_id]++;
+        }
+    }
+
+    // worklist over the cone, ordered by in-cone fanin counts
+    IntList queue;
+    init_intlist(&queue);
+    for (int c = 0; c < cone.count; c++) {
+        if (pending[cone.items[c]] == 0) {
+            add_to_intlist(&queue, cone.items[c]);
+        }
+    }
+
+    for (int q = 0; q < queue.count; q++) {
+        int id = queue.items[q];
+        const int *fanins = gate_fanins(id);
+        int fanin_count = gate_fanin_count(id);
+
+        int level = -1;
+        for (int j = 0; j < fanin_count; j++) {
+            int fanin_level = circuit.gates[fanins[j]].level;
+            if (fanin_level < 0) {
+                level = -1;
+                break;
+            }
+            if (fanin_level + 1 > level) {
+                level = fanin_level + 1;
+            }
+        }
+        set_gate_level(&circuit.gates[id], level);
+
+        const int *fanouts = gate_fanouts(id);
+        int fanout_count = gate_fanout_count(id);
+        for (int j = 0; j < fanout_count; j++) {
+            int fanout_id = fanouts[j];
+            if (pending[fanout_id] > 0 && --pending[fanout_id] == 0) {
+                add_to_intlist(&queue, fanout_id);
             }
         }
     }
+
+    // whatever was never released sits on or behind a combinational loop
+    for (int c = 0; c < cone.count; c++) {
+        int id = cone.items[c];
+        if (pending[id] > 0) {
+            set_gate_level(&circuit.gates[id], -1);
+        }
+        pending[id] = -1;
+    }
+
+    free_intlist(&cone);
+    free_intlist(&queue);
 }
 
+// rewires every multi-fanout gate through BUF gates and re-levelizes the
+// affected cones incrementally, so levels must be assigned beforehand
 void insert_buffers(void) {
     int original_count = circuit.gate_count;
     int buffers_added = 0;
+
+    Connection *edits = NULL;
+    int edit_count = 0;
+    int edit_capacity = 0;
     
     for (int i = 0; i < original_count; i++) {
-        Gate *g = &circuit.gates[i];
-        
-        if (g->fanouts.count > 1) {
-            IntList original_fanouts;
-            init_intlist(&original_fanouts);
-            for (int j = 0; j < g->fanouts.count; j++) {
-                add_to_intlist(&original_fanouts, g->fanouts.items[j]);
+        int fanout_count = gate_fanout_count(i);
+        if (fanout_count <= 1) {
+            continue;
+        }
+
+        // each fanout slot of gate i is redirected to a new BUF in place;
+        // indices rather than pointers since appends may move the edge arrays
+        for (int j = 0; j < fanout_count; j++) {
+            char buf_name[256];
+            int len = snprintf(buf_name, sizeof(buf_name), "%s_buf%d", symbol_name(circuit.gates[i].name), j);
+            if (len >= (int)sizeof(buf_name)) {
+                len = sizeof(buf_name) - 1;
             }
-            
-            free_intlist(&g->fanouts);
-            init_intlist(&g->fanouts);
-            
-            for (int j = 0; j < original_fanouts.count; j++) {
-                char buf_name[256];
-                sprintf(buf_name, "%s_buf%d", g->name, j);
-                
-                add_gate(buf_name, GATE_BUF);
-                int buf_id = circuit.gate_count - 1;
-                
-                add_to_intlist(&g->fanouts, buf_id);
-                add_to_intlist(&circuit.gates[buf_id].fanins, i);
-                
-                int fanout_id = original_fanouts.items[j];
-                Gate *fanout = &circuit.gates[fanout_id];
-                
-                for (int k = 0; k < fanout->fanins.count; k++) {
-                    if (fanout->fanins.items[k] == i) {
-                        fanout->fanins.items[k] = buf_id;
-                        break;
-                    }
+
+            add_gate(intern_string(buf_name, len), GATE_BUF);
+            int buf_id = circuit.gate_count - 1;
+
+            int fanout_id = circuit.fanouts.edges[circuit.fanouts.start[i] + j];
+            circuit.fanouts.edges[circuit.fanouts.start[i] + j] = buf_id;
+            append_edge(&circuit.fanins, buf_id, i);
+            append_edge(&circuit.fanouts, buf_id, fanout_id);
+
+            int *fanins = gate_fanins(fanout_id);
+            for (int k = 0; k < gate_fanin_count(fanout_id); k++) {
+                if (fanins[k] == i) {
+                    fanins[k] = buf_id;
+                    break;
+                }
+            }
+            buffers_added++;
+
+            if (edit_count + 3 > edit_capacity) {
+                edit_capacity = (edit_capacity == 0) ? 64 : edit_capacity * 2;
+                edits = (Connection *)realloc(edits, edit_capacity * sizeof(Connection));
+                if (!edits) {
+                    exit(1);
                 }
-                
-                add_to_intlist(&circuit.gates[buf_id].fanouts, fanout_id);
-                buffers_added++;
             }
-            
-            free_intlist(&original_fanouts);
+            edits[edit_count++] = (Connection){ i, fanout_id };
+            edits[edit_count++] = (Connection){ i, buf_id };
+            edits[edit_count++] = (Connection){ buf_id, fanout_id };
         }
     }
-}
 
-void print_circuit(void) {
-    int max_level = 0;
-    for (int i = 0; i < circuit.gate_count; i++) {
-        if (circuit.gates[i].level > max_level) {
-            max_level = circuit.gates[i].level;
-        }
+    build_csr();
+    update_levels(edits, edit_count);
+    if (edits) {
+        free(edits);
     }
-    
-    printf("\nGate Levels\n");
-    for (int level = 0; level <= max_level; level++) {
-        int count = 0;
-        for (int i = 0; i < circuit.gate_count; i++) {
-            if (circuit.gates[i].level == level) {
-                count++;
-            }
-        }
-        printf("Level %d: %d gates\n", level, count);
+}
+
+void print_circuit(const char *filename) {
+    FILE *log = circuit_log ? circuit_log : stdout;
+
+    fprintf(log, "\nGate Levels\n");
+    for (int level = 0; level <= circuit.max_level; level++) {
+        int count = circuit.level_counts ? circuit.level_counts[level] : 0;
+        fprintf(log, "Level %d: %d gates\n", level, count);
     }
     
-    printf("\nCircuit Description\n");
-    printf("%d %d %d %d\n", circuit.gate_count, circuit.input_count, 
+    fprintf(log, "\nCircuit Description\n");
+    fprintf(log, "%d %d %d %d\n", circuit.gate_count, circuit.input_count, 
             circuit.output_count, circuit.dff_count);
     
     for (int i = 0; i < circuit.gate_count; i++) {
         Gate *g = &circuit.gates[i];
         
-        printf("%d %d %d %d", (int)g->type, g->is_output, g->level, g->fanins.count);
+        const int *fanins = gate_fanins(i);
+        const int *fanouts = gate_fanouts(i);
+        
+        fprintf(log, "%d %d %d %d", (int)g->type, g->is_output, g->level, gate_fanin_count(i));
         
-        for (int j = 0; j < g->fanins.count; j++) {
-            printf(" %d", g->fanins.items[j]);
+        for (int j = 0; j < gate_fanin_count(i); j++) {
+            fprintf(log, " %d", fanins[j]);
         }
         
-        printf(" %d", g->fanouts.count);
-        for (int j = 0; j < g->fanouts.count; j++) {
-            printf(" %d", g->fanouts.items[j]);
+        fprintf(log, " %d", gate_fanout_count(i));
+        for (int j = 0; j < gate_fanout_count(i); j++) {
+            fprintf(log, " %d", fanouts[j]);
         }
         
-        printf(" %s\n", g->name);
+        fprintf(log, " %s\n", symbol_name(g->name));
     }
     
-    FILE *fp = fopen("circuit_output.txt", "w");
+    FILE *fp = fopen(filename, "w");
     if (!fp) {
         return;
     }
@@ -267,37 +763,143 @@ void print_circuit(void) {
     for (int i = 0; i < circuit.gate_count; i++) {
         Gate *g = &circuit.gates[i];
         
-        fprintf(fp, "%d %d %d %d", (int)g->type, g->is_output, g->level, g->fanins.count);
+        const int *fanins = gate_fanins(i);
+        const int *fanouts = gate_fanouts(i);
         
-        for (int j = 0; j < g->fanins.count; j++) {
-            fprintf(fp, " %d", g->fanins.items[j]);
+        fprintf(fp, "%d %d %d %d", (int)g->type, g->is_output, g->level, gate_fanin_count(i));
+        
+        for (int j = 0; j < gate_fanin_count(i); j++) {
+            fprintf(fp, " %d", fanins[j]);
         }
         
-        fprintf(fp, " %d", g->fanouts.count);
-        for (int j = 0; j < g->fanouts.count; j++) {
-            fprintf(fp, " %d", g->fanouts.items[j]);
+        fprintf(fp, " %d", gate_fanout_count(i));
+        for (int j = 0; j < gate_fanout_count(i); j++) {
+            fprintf(fp, " %d", fanouts[j]);
         }
         
-        fprintf(fp, " %s\n", g->name);
+        fprintf(fp, " %s\n", symbol_name(g->name));
     }
     
     fclose(fp);
-    printf("\nCircuit description saved to circuit_output.txt\n");
+    fprintf(log, "\nCircuit description saved to %s\n", filename);
 }
 
-void free_circuit(void) {
-    for (int i = 0; i < circuit.gate_count; i++) {
-        free(circuit.gates[i].name);
-        if (circuit.gates[i].output_wire) { 
-            free(circuit.gates[i].output_wire);
-        }
-        free_intlist(&circuit.gates[i].fanins);
-        free_intlist(&circuit.gates[i].fanouts);
+static uint64_t align8(uint64_t offset) {
+    return (offset + 7) & ~(uint64_t)7;
+}
+
+// writes count elements of size bytes at the given (aligned) file offset
+static void write_section(FILE *fp, uint64_t *pos, uint64_t offset, const void *data, size_t size, size_t count) {
+    static const char zeros[8] = {0};
+    fwrite(zeros, 1, offset - *pos, fp);
+    if (count > 0) {
+        fwrite(data, size, count, fp);
     }
-    
+    *pos = offset + (uint64_t)size * count;
+}
+
+int write_circuit_binary(const char *filename) {
+    int n = circuit.gate_count;
+    CircuitFileHeader h;
+    memset(&h, 0, sizeof(h));
+
+    int32_t *fanin_offsets = (int32_t *)malloc((n + 1) * sizeof(int32_t));
+    int32_t *fanout_offsets = (int32_t *)malloc((n + 1) * sizeof(int32_t));
+    uint8_t *types = (uint8_t *)malloc(n + 1);
+    uint8_t *flags = (uint8_t *)malloc(n + 1);
+    int32_t *levels = (int32_t *)malloc((n + 1) * sizeof(int32_t));
+    uint32_t *name_offsets = (uint32_t *)malloc((n + 1) * sizeof(uint32_t));
+    if (!fanin_offsets || !fanout_offsets || !types || !flags || !levels || !name_offsets) {
+        exit(1);
+    }
+
+    fanin_offsets[0] = 0;
+    fanout_offsets[0] = 0;
+    for (int i = 0; i < n; i++) {
+        Gate *g = &circuit.gates[i];
+        fanin_offsets[i + 1] = fanin_offsets[i] + gate_fanin_count(i);
+        fanout_offsets[i + 1] = fanout_offsets[i] + gate_fanout_count(i);
+        types[i] = (uint8_t)g->type;
+        flags[i] = g->is_output ? CIRCUIT_FLAG_OUTPUT : 0;
+        levels[i] = g->level;
+        // gate names are arena strings, so the arena doubles as the name table
+        name_offsets[i] = circuit.strings.offsets[g->name];
+    }
+
+    h.magic = CIRCUIT_BIN_MAGIC;
+    h.version = CIRCUIT_BIN_VERSION;
+    h.gate_count = n;
+    h.input_count = circuit.input_count;
+    h.output_count = circuit.output_count;
+    h.dff_count = circuit.dff_count;
+    h.fanin_edges = fanin_offsets[n];
+    h.fanout_edges = fanout_offsets[n];
+    h.max_level = circuit.max_level;
+    h.names_size = (uint32_t)circuit.strings.used;
+
+    h.fanin_offsets = align8(sizeof(h));
+    h.fanins = align8(h.fanin_offsets + (uint64_t)(n + 1) * sizeof(int32_t));
+    h.fanout_offsets = align8(h.fanins + (uint64_t)h.fanin_edges * sizeof(int32_t));
+    h.fanouts = align8(h.fanout_offsets + (uint64_t)(n + 1) * sizeof(int32_t));
+    h.types = align8(h.fanouts + (uint64_t)h.fanout_edges * sizeof(int32_t));
+    h.flags = align8(h.types + n);
+    h.levels = align8(h.flags + n);
+    h.name_offsets = align8(h.levels + (uint64_t)n * sizeof(int32_t));
+    h.names = align8(h.name_offsets + (uint64_t)n * sizeof(uint32_t));
+
+    FILE *fp = fopen(filename, "wb");
+    if (!fp) {
+        fprintf(stderr, "Could not open binary output file (%s)\n", filename);
+        free(fanin_offsets); free(fanout_offsets); free(types);
+        free(flags); free(levels); free(name_offsets);
+        return -1;
+    }
+
+    uint64_t pos = 0;
+    write_section(fp, &pos, 0, &h, sizeof(h), 1);
+    write_section(fp, &pos, h.fanin_offsets, fanin_offsets, sizeof(int32_t), n + 1);
+    for (int i = 0; i < n; i++) {
+        write_section(fp, &pos, i == 0 ? h.fanins : pos, gate_fanins(i), sizeof(int32_t), gate_fanin_count(i));
+    }
+    write_section(fp, &pos, h.fanout_offsets, fanout_offsets, sizeof(int32_t), n + 1);
+    for (int i = 0; i < n; i++) {
+        write_section(fp, &pos, i == 0 ? h.fanouts : pos, gate_fanouts(i), sizeof(int32_t), gate_fanout_count(i));
+    }
+    write_section(fp, &pos, h.types, types, 1, n);
+    write_section(fp, &pos, h.flags, flags, 1, n);
+    write_section(fp, &pos, h.levels, levels, sizeof(int32_t), n);
+    write_section(fp, &pos, h.name_offsets, name_offsets, sizeof(uint32_t), n);
+    write_section(fp, &pos, h.names, circuit.strings.data, 1, h.names_size);
+
+    int failed = ferror(fp);
+    fclose(fp);
+
+    free(fanin_offsets);
+    free(fanout_offsets);
+    free(types);
+    free(flags);
+    free(levels);
+    free(name_offsets);
+
+    if (failed) {
+        fprintf(stderr, "Failed writing binary output file (%s)\n", filename);
+        return -1;
+    }
+    log_printf("Circuit description saved to %s\n", filename);
+    return 0;
+}
+
+void free_circuit(void) {
     if (circuit.gates) {
         free(circuit.gates);
     }
+    free_adjacency(&circuit.fanins);
+    free_adjacency(&circuit.fanouts);
+    free_arena(&circuit.strings);
+    if (circuit.gate_by_name) free(circuit.gate_by_name);
+    if (circuit.driver_by_wire) free(circuit.driver_by_wire);
+    if (circuit.level_counts) free(circuit.level_counts);
+    if (circuit.pending) free(circuit.pending);
     
     init_circuit();
 }
@@ -306,15 +908,14 @@ void connect_gates_to_output_wires(void) {
     for (int i = 0; i < circuit.gate_count; i++) {
         Gate *g = &circuit.gates[i];
         
-        if (!g->output_wire || g->type == GATE_INPUT || g->type == GATE_DFF) {
+        if (g->output_wire == NO_SYMBOL || g->type == GATE_INPUT || g->type == GATE_DFF) {
             continue;
         }
         
         int wire_id = find_gate_by_name(g->output_wire);
         
         if (wire_id >= 0 && wire_id != i && circuit.gates[wire_id].type == GATE_WIRE) {
-            add_to_intlist(&g->fanouts, wire_id);
-            add_to_intlist(&circuit.gates[wire_id].fanins, i);
+            connect_gates(i, wire_id);
         }
     }
 }
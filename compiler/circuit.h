@@ -4,6 +4,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <stdint.h>
 
 typedef enum {
     GATE_INPUT = 0,
@@ -20,55 +21,169 @@ typedef enum {
     GATE_WIRE = 11
 } GateType;
 
-// struct to hold a list of integers (for fanins/fanouts)
+// struct to hold a growable list of integers (worklists, scratch sets)
 typedef struct IntList {
     int *items;
     int count;
     int capacity;
 } IntList;
 
+// interned identifier: dense 32-bit handle into the circuit's string arena
+typedef unsigned int Symbol;
+#define NO_SYMBOL ((Symbol)-1)
+
+// growable list of symbols (parser port lists, deferred DFF connections)
+typedef struct SymbolList {
+    Symbol *items;
+    int count;
+    int capacity;
+} SymbolList;
+
+// bump-allocated arena storing every distinct identifier exactly once
+typedef struct StringArena {
+    char *data;                 // NUL-terminated strings, back to back
+    size_t used;
+    size_t capacity;
+    unsigned int *offsets;      // symbol -> offset into data
+    unsigned int *hashes;       // symbol -> cached hash
+    int count;
+    int symbol_capacity;
+    Symbol *slots;              // open-addressing table, NO_SYMBOL when empty
+    int slot_capacity;          // always a power of two
+} StringArena;
+
 // struct for a gate
 typedef struct Gate {
     int id;
-    char *name;              
-    char *output_wire;      
+    Symbol name;
+    Symbol output_wire;         // NO_SYMBOL until the gate is given one
     GateType type;
     int is_output;
     int level;
-    IntList fanins;
-    IntList fanouts;
 } Gate;
 
+// Compressed-sparse-row adjacency shared by all gates: gate i's neighbours
+// are edges[start[i]] .. edges[start[i] + count[i] - 1]. Edits may move a
+// gate's segment to the end of edges and leave holes behind; build_csr()
+// packs it back so segments are contiguous and in gate order.
+typedef struct Adjacency {
+    int *start;
+    int *count;
+    int *capacity;              // per-gate segment capacity
+    int *edges;
+    int edge_used;              // slots handed out in edges, holes included
+    int edge_capacity;
+} Adjacency;
+
 // circuit struct
 typedef struct Circuit {
     Gate *gates;
     int gate_count;
     int gate_capacity;
+    Adjacency fanins;
+    Adjacency fanouts;
     int input_count;
     int output_count;
     int dff_count;
+    StringArena strings;
+    int *gate_by_name;          // symbol -> gate id, -1 if none
+    int *driver_by_wire;        // symbol -> driving gate id, -1 if none
+    int map_capacity;
+    int max_level;
+    int *level_counts;          // gates per level, filled by assign_levels
+    int level_capacity;
+    int *pending;               // update_levels scratch, -1 outside a call
+    int pending_capacity;
 } Circuit;
 
-// global circuit
-extern Circuit circuit;
+// a fanout edge, used to describe netlist edits to update_levels
+typedef struct Connection {
+    int from;
+    int to;
+} Connection;
+
+// Binary intermediate file, an alternative to circuit_output.txt that the
+// simulator maps and uses in place. All sections are native-endian arrays
+// at 8-byte aligned offsets from the start of the file; fanins/fanouts are
+// stored CSR style (gate i owns [offsets[i], offsets[i + 1])).
+#define CIRCUIT_BIN_MAGIC   0x5a4c5256u     // "VRLZ"
+#define CIRCUIT_BIN_VERSION 1
+
+#define CIRCUIT_FLAG_OUTPUT 0x1
+
+typedef struct CircuitFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t gate_count;
+    uint32_t input_count;
+    uint32_t output_count;
+    uint32_t dff_count;
+    uint32_t fanin_edges;
+    uint32_t fanout_edges;
+    int32_t max_level;
+    uint32_t names_size;
+    uint64_t fanin_offsets;     // int32_t[gate_count + 1]
+    uint64_t fanins;            // int32_t[fanin_edges]
+    uint64_t fanout_offsets;    // int32_t[gate_count + 1]
+    uint64_t fanouts;           // int32_t[fanout_edges]
+    uint64_t types;             // uint8_t[gate_count], GateType
+    uint64_t flags;             // uint8_t[gate_count], CIRCUIT_FLAG_*
+    uint64_t levels;            // int32_t[gate_count]
+    uint64_t name_offsets;      // uint32_t[gate_count], into names
+    uint64_t names;             // char[names_size], NUL-terminated strings
+} CircuitFileHeader;
+
+// the circuit being compiled; each thread has its own, so several files
+// can be compiled at once (see main.c)
+extern __thread Circuit circuit;
+
+// where log_printf writes for this thread, stdout when NULL
+extern __thread FILE *circuit_log;
 
 // function prototypes
 void init_circuit(void);
-void add_gate(const char *name, GateType type);
-int find_gate_by_name(const char *name);
-void add_connection(const char *from_name, const char *to_name);
-void set_gate_as_output(const char *name);
+void add_gate(Symbol name, GateType type);
+int find_gate_by_name(Symbol name);
+int find_gate_by_output_wire(Symbol wire_name);
+void set_gate_output_wire(int gate_id, Symbol wire_name);
+void add_connection(Symbol from_name, Symbol to_name);
+void connect_gates(int from_id, int to_id);
+void disconnect_gates(int from_id, int to_id);
+void build_csr(void);
+void set_gate_as_output(Symbol name);
 void assign_levels(void);
+void update_levels(const Connection *edits, int edit_count);
 void insert_buffers(void);
-void print_circuit(void);
+void print_circuit(const char *filename);
+int write_circuit_binary(const char *filename);
 void free_circuit(void);
 void resolve_dff_connections(void);
+int fast_parse(const char *text, size_t length);
+
+// string arena functions
+Symbol intern_string(const char *s, int len);
+Symbol find_symbol(const char *s);
+const char *symbol_name(Symbol sym);
 
 // IntList helper functions
 void init_intlist(IntList *list);
 void add_to_intlist(IntList *list, int value);
 void free_intlist(IntList *list);
 
+// SymbolList helper functions
+void init_symbollist(SymbolList *list);
+void add_to_symbollist(SymbolList *list, Symbol value);
+void free_symbollist(SymbolList *list);
+
 void connect_gates_to_output_wires(void);
 
+// printf to circuit_log
+void log_printf(const char *format, ...) __attribute__((format(printf, 1, 2)));
+
+// CSR accessors; the pointers are invalidated by connect/disconnect_gates
+static inline int gate_fanin_count(int id) { return circuit.fanins.count[id]; }
+static inline int *gate_fanins(int id) { return circuit.fanins.edges + circuit.fanins.start[id]; }
+static inline int gate_fanout_count(int id) { return circuit.fanouts.count[id]; }
+static inline int *gate_fanouts(int id) { return circuit.fanouts.edges + circuit.fanouts.start[id]; }
+
 #endif
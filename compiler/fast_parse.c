@@ -0,0 +1,257 @@
+#include "circuit.h"
+
+/*
+ * Hand-written recursive-descent parser for flat gate-level netlists
+ * (ISCAS style: a single module with input/output/wire declarations and
+ * primitive gate instances, exactly what parse.y accepts).
+ *
+ * It builds the circuit with the same calls, in the same order, as the
+ * bison actions in parse.y, and interns identifiers in the same order as
+ * the flex scanner, so the resulting Circuit is identical. The input is
+ * only read, never copied or NUL-terminated. Anything outside that subset
+ * (escaped identifiers, numbers, strings, nested comments, syntax errors)
+ * makes it give up and return -1; the caller then discards the partial
+ * circuit and reruns the bison grammar, which also does error recovery.
+ */
+
+typedef enum {
+    TOK_END,
+    TOK_NAME,
+    TOK_PUNCT,
+    TOK_OTHER
+} TokenKind;
+
+typedef struct FastParser {
+    const char *p;
+    const char *end;
+    TokenKind kind;
+    const char *text;           // current token, not NUL-terminated
+    int len;
+    SymbolList dff_d_inputs;
+    SymbolList dff_q_outputs;
+    SymbolList ports;
+} FastParser;
+
+static int is_name_start(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+static int is_name_char(char c) {
+    return is_name_start(c) || (c >= '0' && c <= '9');
+}
+
+// skips blanks and comments; returns -1 on a comment the scanner would
+// treat differently (unterminated, nested)
+static int skip_space(FastParser *fp) {
+    const char *p = fp->p;
+    const char *end = fp->end;
+
+    while (p < end) {
+        char c = *p;
+        if (c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\b') {
+            p++;
+        } else if (c == '/' && p + 1 < end && p[1] == '/') {
+            while (p < end && *p != '\n') p++;
+            if (p == end) return -1;
+            p++;
+        } else if (c == '/' && p + 1 < end && p[1] == '*') {
+            p += 2;
+            while (p + 1 < end && !(p[0] == '*' && p[1] == '/')) {
+                if (p[0] == '/' && p[1] == '*') return -1;
+                p++;
+            }
+            if (p + 1 >= end) return -1;
+            p += 2;
+        } else {
+            break;
+        }
+    }
+
+    fp->p = p;
+    return 0;
+}
+
+static void next_token(FastParser *fp) {
+    if (skip_space(fp) != 0) {
+        fp->kind = TOK_OTHER;
+        return;
+    }
+
+    const char *p = fp->p;
+    fp->text = p;
+    if (p == fp->end) {
+        fp->kind = TOK_END;
+        fp->len = 0;
+    } else if (is_name_start(*p)) {
+        while (p < fp->end && is_name_char(*p)) p++;
+        fp->kind = TOK_NAME;
+        fp->len = p - fp->text;
+    } else if (*p == '(' || *p == ')' || *p == ',' || *p == ';') {
+        p++;
+        fp->kind = TOK_PUNCT;
+        fp->len = 1;
+    } else {
+        fp->kind = TOK_OTHER;
+        fp->len = 0;
+    }
+    fp->p = p;
+}
+
+static int is_keyword(const FastParser *fp, const char *keyword) {
+    int len = strlen(keyword);
+    return fp->kind == TOK_NAME && fp->len == len && memcmp(fp->text, keyword, len) == 0;
+}
+
+static int is_punct(const FastParser *fp, char c) {
+    return fp->kind == TOK_PUNCT && fp->text[0] == c;
+}
+
+static int expect_punct(FastParser *fp, char c) {
+    if (!is_punct(fp, c)) {
+        return -1;
+    }
+    next_token(fp);
+    return 0;
+}
+
+static const char *keywords[] = {
+    "module", "endmodule", "input", "output", "wire",
+    "and", "nand", "or", "nor", "xor", "xnor", "buf", "not", "dff", NULL
+};
+
+// consumes an identifier (not a keyword) and interns it
+static int expect_name(FastParser *fp, Symbol *sym) {
+    if (fp->kind != TOK_NAME) {
+        return -1;
+    }
+    for (int i = 0; keywords[i]; i++) {
+        if (is_keyword(fp, keywords[i])) {
+            return -1;
+        }
+    }
+    *sym = intern_string(fp->text, fp->len);
+    next_token(fp);
+    return 0;
+}
+
+// NAME { ',' NAME } into fp->ports
+static int parse_name_list(FastParser *fp) {
+    Symbol sym;
+    fp->ports.count = 0;
+    for (;;) {
+        if (expect_name(fp, &sym) != 0) {
+            return -1;
+        }
+        add_to_symbollist(&fp->ports, sym);
+        if (!is_punct(fp, ',')) {
+            return 0;
+        }
+        next_token(fp);
+    }
+}
+
+static int gate_keyword_type(const FastParser *fp, GateType *type) {
+    static const struct { const char *keyword; GateType type; } gates[] = {
+        { "and", GATE_AND }, { "nand", GATE_NAND }, { "or", GATE_OR },
+        { "nor", GATE_NOR }, { "xor", GATE_XOR }, { "xnor", GATE_XNOR },
+        { "buf", GATE_BUF }, { "not", GATE_NOT }, { "dff", GATE_DFF }
+    };
+    for (size_t i = 0; i < sizeof(gates) / sizeof(gates[0]); i++) {
+        if (is_keyword(fp, gates[i].keyword)) {
+            *type = gates[i].type;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int parse_gate(FastParser *fp, GateType type) {
+    Symbol gate_name;
+    if (expect_name(fp, &gate_name) != 0 || expect_punct(fp, '(') != 0 ||
+        parse_name_list(fp) != 0 || expect_punct(fp, ')') != 0 || expect_punct(fp, ';') != 0) {
+        return -1;
+    }
+
+    add_gate(gate_name, type);
+    int gate_idx = circuit.gate_count - 1;
+
+    Symbol *ports = fp->ports.items;
+    set_gate_output_wire(gate_idx, ports[0]);
+    if (type == GATE_DFF) {
+        // DFF: port[0] is Q, port[1] is D, connected once all gates exist
+        if (fp->ports.count >= 2) {
+            add_to_symbollist(&fp->dff_d_inputs, ports[1]);
+            add_to_symbollist(&fp->dff_q_outputs, ports[0]);
+        }
+    } else {
+        for (int i = 1; i < fp->ports.count; i++) {
+            add_connection(ports[i], ports[0]);
+        }
+    }
+    return 0;
+}
+
+static int parse_module(FastParser *fp) {
+    Symbol sym;
+    if (!is_keyword(fp, "module")) {
+        return -1;
+    }
+    next_token(fp);
+    if (expect_name(fp, &sym) != 0 || expect_punct(fp, '(') != 0 ||
+        parse_name_list(fp) != 0 || expect_punct(fp, ')') != 0 || expect_punct(fp, ';') != 0) {
+        return -1;
+    }
+
+    int items = 0;
+    while (!is_keyword(fp, "endmodule")) {
+        GateType type;
+        if (is_keyword(fp, "input")) {
+            next_token(fp);
+            if (parse_name_list(fp) != 0 || expect_punct(fp, ';') != 0) return -1;
+            for (int i = 0; i < fp->ports.count; i++) {
+                add_gate(fp->ports.items[i], GATE_INPUT);
+                set_gate_output_wire(circuit.gate_count - 1, fp->ports.items[i]);
+            }
+        } else if (is_keyword(fp, "output")) {
+            next_token(fp);
+            if (parse_name_list(fp) != 0 || expect_punct(fp, ';') != 0) return -1;
+            for (int i = 0; i < fp->ports.count; i++) {
+                set_gate_as_output(fp->ports.items[i]);
+            }
+        } else if (is_keyword(fp, "wire")) {
+            next_token(fp);
+            if (parse_name_list(fp) != 0 || expect_punct(fp, ';') != 0) return -1;
+        } else if (gate_keyword_type(fp, &type)) {
+            next_token(fp);
+            if (parse_gate(fp, type) != 0) return -1;
+        } else {
+            return -1;
+        }
+        items++;
+    }
+    next_token(fp);
+
+    return (items > 0 && fp->kind == TOK_END) ? 0 : -1;
+}
+
+int fast_parse(const char *text, size_t length) {
+    FastParser fp;
+    fp.p = text;
+    fp.end = text + length;
+    init_symbollist(&fp.dff_d_inputs);
+    init_symbollist(&fp.dff_q_outputs);
+    init_symbollist(&fp.ports);
+
+    next_token(&fp);
+    int result = parse_module(&fp);
+    if (result == 0) {
+        for (int i = 0; i < fp.dff_d_inputs.count; i++) {
+            add_connection(fp.dff_d_inputs.items[i], fp.dff_q_outputs.items[i]);
+        }
+    }
+
+    free_symbollist(&fp.dff_d_inputs);
+    free_symbollist(&fp.dff_q_outputs);
+    free_symbollist(&fp.ports);
+    return result;
+}
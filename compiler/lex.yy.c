@@ -154,9 +154,9 @@ typedef struct yy_buffer_state *YY_BUFFER_STATE;
 typedef size_t yy_size_t;
 #endif
 
-extern int yyleng;
+extern __thread int yyleng;
 
-extern FILE *yyin, *yyout;
+extern __thread FILE *yyin, *yyout;
 
 #define EOB_ACT_CONTINUE_SCAN 0
 #define EOB_ACT_END_OF_FILE 1
@@ -246,9 +246,9 @@ struct yy_buffer_state
 #endif /* !YY_STRUCT_YY_BUFFER_STATE */
 
 /* Stack of input buffers. */
-static size_t yy_buffer_stack_top = 0; /**< index of top of stack. */
-static size_t yy_buffer_stack_max = 0; /**< capacity of stack. */
-static YY_BUFFER_STATE * yy_buffer_stack = NULL; /**< Stack as an array. */
+static __thread size_t yy_buffer_stack_top = 0; /**< index of top of stack. */
+static __thread size_t yy_buffer_stack_max = 0; /**< capacity of stack. */
+static __thread YY_BUFFER_STATE * yy_buffer_stack = NULL; /**< Stack as an array. */
 
 /* We provide macros for accessing buffer states in case in the
  * future we want to put the buffer states in a more general
@@ -265,19 +265,19 @@ static YY_BUFFER_STATE * yy_buffer_stack = NULL; /**< Stack as an array. */
 #define YY_CURRENT_BUFFER_LVALUE (yy_buffer_stack)[(yy_buffer_stack_top)]
 
 /* yy_hold_char holds the character lost when yytext is formed. */
-static char yy_hold_char;
-static int yy_n_chars;		/* number of characters read into yy_ch_buf */
-int yyleng;
+static __thread char yy_hold_char;
+static __thread int yy_n_chars;		/* number of characters read into yy_ch_buf */
+__thread int yyleng;
 
 /* Points to current character in buffer. */
-static char *yy_c_buf_p = NULL;
-static int yy_init = 0;		/* whether we need to initialize */
-static int yy_start = 0;	/* start state number */
+static __thread char *yy_c_buf_p = NULL;
+static __thread int yy_init = 0;		/* whether we need to initialize */
+static __thread int yy_start = 0;	/* start state number */
 
 /* Flag which is used to allow yywrap()'s to do buffer switches
  * instead of setting up a fresh yyin.  A bit of a hack ...
  */
-static int yy_did_buffer_switch_on_eof;
+static __thread int yy_did_buffer_switch_on_eof;
 
 void yyrestart ( FILE *input_file  );
 void yy_switch_to_buffer ( YY_BUFFER_STATE new_buffer  );
@@ -324,14 +324,14 @@ void yyfree ( void *  );
 /* Begin user sect3 */
 typedef flex_uint8_t YY_CHAR;
 
-FILE *yyin = NULL, *yyout = NULL;
+__thread FILE *yyin = NULL, *yyout = NULL;
 
 typedef int yy_state_type;
 
-extern int yylineno;
-int yylineno = 1;
+extern __thread int yylineno;
+__thread int yylineno = 1;
 
-extern char *yytext;
+extern __thread char *yytext;
 #ifdef yytext_ptr
 #undef yytext_ptr
 #endif
@@ -516,11 +516,11 @@ static const flex_int16_t yy_chk[268] =
       104,  104,  104,  104,  104,  104,  104
     } ;
 
-static yy_state_type yy_last_accepting_state;
-static char *yy_last_accepting_cpos;
+static __thread yy_state_type yy_last_accepting_state;
+static __thread char *yy_last_accepting_cpos;
 
-extern int yy_flex_debug;
-int yy_flex_debug = 0;
+extern __thread int yy_flex_debug;
+__thread int yy_flex_debug = 0;
 
 /* The intent behind this definition is that it'll catch
  * any uses of REJECT which flex missed.
@@ -529,7 +529,7 @@ int yy_flex_debug = 0;
 #define yymore() yymore_used_but_not_detected
 #define YY_MORE_ADJ 0
 #define YY_RESTORE_YY_MORE_OFFSET
-char *yytext;
+__thread char *yytext;
 #line 1 "tokens.l"
 #line 2 "tokens.l"
 /*
@@ -539,18 +539,24 @@ char *yytext;
 # define YYLMAX 200
 #include <stdlib.h>
 #include <string.h>
-extern int yylineno;
+extern __thread int yylineno;
 int yylook();
 int yyback(int*,int);
 int yywrap();
-extern YYSTYPE yylval;
+/*
+ * The parser is pure, so the token value is passed in. Every mutable
+ * global flex generates is made thread-local after generation (see
+ * thread_local.sed), so threads can scan files at the same time.
+ */
+#define YY_DECL int yylex(YYSTYPE *yylval_param)
+#define yylval (*yylval_param)
 static int scanTable = 0;
 
 static void skipComments();
 unsigned long stringToNumber(const char *s);
-#line 551 "lex.yy.c"
+#line 557 "lex.yy.c"
 
-#line 553 "lex.yy.c"
+#line 559 "lex.yy.c"
 
 #define INITIAL 0
 #define Snormal 1
@@ -769,15 +775,15 @@ YY_DECL
 		}
 
 	{
-#line 43 "tokens.l"
+#line 49 "tokens.l"
 
-#line 45 "tokens.l"
+#line 51 "tokens.l"
 				if(scanTable)
 					BEGIN Stable;
 				else
 					BEGIN Snormal;
 
-#line 780 "lex.yy.c"
+#line 786 "lex.yy.c"
 
 	while ( /*CONSTCOND*/1 )		/* loops until end-of-file is reached */
 		{
@@ -836,30 +842,30 @@ do_action:	/* This label is used only to access EOF actions. */
 
 case 1:
 YY_RULE_SETUP
-#line 50 "tokens.l"
+#line 56 "tokens.l"
 { continue; }
 	YY_BREAK
 case 2:
 /* rule 2 can match eol */
 YY_RULE_SETUP
-#line 51 "tokens.l"
+#line 57 "tokens.l"
 { yylineno++; continue; }
 	YY_BREAK
 case 3:
 YY_RULE_SETUP
-#line 54 "tokens.l"
+#line 60 "tokens.l"
 { skipComments(); continue; }
 	YY_BREAK
 case 4:
 /* rule 4 can match eol */
 YY_RULE_SETUP
-#line 55 "tokens.l"
+#line 61 "tokens.l"
 { yylineno++; continue; }
 	YY_BREAK
 case 5:
 /* rule 5 can match eol */
 YY_RULE_SETUP
-#line 57 "tokens.l"
+#line 63 "tokens.l"
 { 
 				yylval.id = (char *)yytext;
 				return _STRING; 
@@ -867,138 +873,138 @@ YY_RULE_SETUP
 	YY_BREAK
 case 6:
 YY_RULE_SETUP
-#line 62 "tokens.l"
+#line 68 "tokens.l"
 { return BUF; }
 	YY_BREAK
 case 7:
 YY_RULE_SETUP
-#line 63 "tokens.l"
+#line 69 "tokens.l"
 { return MODULE; }
 	YY_BREAK
 case 8:
 YY_RULE_SETUP
-#line 64 "tokens.l"
+#line 70 "tokens.l"
 { return ENDMODULE; }
 	YY_BREAK
 case 9:
 YY_RULE_SETUP
-#line 65 "tokens.l"
+#line 71 "tokens.l"
 { return INPUT; }
 	YY_BREAK
 case 10:
 YY_RULE_SETUP
-#line 66 "tokens.l"
+#line 72 "tokens.l"
 { return NAND; }
 	YY_BREAK
 case 11:
 YY_RULE_SETUP
-#line 67 "tokens.l"
+#line 73 "tokens.l"
 { return OR; }
 	YY_BREAK
 case 12:
 YY_RULE_SETUP
-#line 68 "tokens.l"
+#line 74 "tokens.l"
 { return NOR; }
 	YY_BREAK
 case 13:
 YY_RULE_SETUP
-#line 69 "tokens.l"
+#line 75 "tokens.l"
 { return NOT; }
 	YY_BREAK
 case 14:
 YY_RULE_SETUP
-#line 70 "tokens.l"
+#line 76 "tokens.l"
 { return OUTPUT; }
 	YY_BREAK
 case 15:
 YY_RULE_SETUP
-#line 71 "tokens.l"
+#line 77 "tokens.l"
 { return XNOR; }
 	YY_BREAK
 case 16:
 YY_RULE_SETUP
-#line 72 "tokens.l"
+#line 78 "tokens.l"
 { return XOR; }
 	YY_BREAK
 case 17:
 YY_RULE_SETUP
-#line 73 "tokens.l"
+#line 79 "tokens.l"
 { return DFF; }
 	YY_BREAK
 case 18:
 YY_RULE_SETUP
-#line 74 "tokens.l"
+#line 80 "tokens.l"
 { return WIRE; }
 	YY_BREAK
 case 19:
 YY_RULE_SETUP
-#line 75 "tokens.l"
+#line 81 "tokens.l"
 { return AND; }
 	YY_BREAK
 case 20:
 YY_RULE_SETUP
-#line 77 "tokens.l"
+#line 83 "tokens.l"
 { 
-                printf(" %s  ", yytext);
-		yylval.id = (char *)yytext; // yytext -> need to copy to declared space
+                log_printf(" %s  ", yytext);
+		yylval.sym = intern_string(yytext, yyleng);
 		return _NAME; 
                               }
 	YY_BREAK
 case 21:
 /* rule 21 can match eol */
 YY_RULE_SETUP
-#line 82 "tokens.l"
+#line 88 "tokens.l"
 {
-		yylval.id = (char *)yytext;
+		yylval.sym = intern_string(yytext, yyleng);
 		return _NAME;
 }
 	YY_BREAK
 case 22:
 YY_RULE_SETUP
-#line 86 "tokens.l"
+#line 92 "tokens.l"
 { return _NUMBER; }
 	YY_BREAK
 case 23:
 YY_RULE_SETUP
-#line 87 "tokens.l"
+#line 93 "tokens.l"
 { return _NUMBER; }
 	YY_BREAK
 case 24:
 YY_RULE_SETUP
-#line 88 "tokens.l"
+#line 94 "tokens.l"
 { yylval.ln=stringToNumber(yytext); return _NUMBER; }
 	YY_BREAK
 case 25:
 YY_RULE_SETUP
-#line 89 "tokens.l"
+#line 95 "tokens.l"
 { yylval.ln = stringToNumber(yytext); return _BASENUMBER; }
 	YY_BREAK
 case 26:
 YY_RULE_SETUP
-#line 90 "tokens.l"
+#line 96 "tokens.l"
 { yylval.ln = stringToNumber(yytext); return _BASENUMBER; }
 	YY_BREAK
 case 27:
 YY_RULE_SETUP
-#line 91 "tokens.l"
+#line 97 "tokens.l"
 { yylval.ln = stringToNumber(yytext); return _BASENUMBER; }
 	YY_BREAK
 case 28:
 YY_RULE_SETUP
-#line 92 "tokens.l"
+#line 98 "tokens.l"
 { yylval.ln = stringToNumber(yytext); return _BASENUMBER; }
 	YY_BREAK
 case 29:
 YY_RULE_SETUP
-#line 93 "tokens.l"
+#line 99 "tokens.l"
 {return yytext[0];}
 	YY_BREAK
 case 30:
 YY_RULE_SETUP
-#line 95 "tokens.l"
+#line 101 "tokens.l"
 ECHO;
 	YY_BREAK
-#line 1001 "lex.yy.c"
+#line 1007 "lex.yy.c"
 case YY_STATE_EOF(INITIAL):
 case YY_STATE_EOF(Snormal):
 case YY_STATE_EOF(Stable):
@@ -2005,7 +2011,7 @@ void yyfree (void * ptr )
 
 #define YYTABLES_NAME "yytables"
 
-#line 95 "tokens.l"
+#line 101 "tokens.l"
 
 
 
@@ -2111,7 +2117,7 @@ unsigned long hex_convert2bin(buf,nbits) char *buf; unsigned nbits;
 			case 'F':
 			case 'f': d = 15; break;
 			default: buf[l] = '0' ; d=0;
-				printf("Wrong digit '%c' in string %s \n", buf[l], buf);
+				log_printf("Wrong digit '%c' in string %s \n", buf[l], buf);
 		}
 		d = d << (w-1)*4;
 		n = n | d;
@@ -2140,7 +2146,7 @@ unsigned long oct_convert2bin(buf,nbits) char *buf; unsigned nbits;
 			case '6': d = 6; break;
 			case '7': d = 7; break;
 			default: buf[l] = '0' ; d=0;
-				printf("Wrong digit '%c'", buf[l]);
+				log_printf("Wrong digit '%c'", buf[l]);
 		}
 		d = d << (w-1)*3;
 		n = n | d;
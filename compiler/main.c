@@ -2,49 +2,340 @@
 #include <string.h>
 #include <stdio.h>
 #include <strings.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <pthread.h>
 #include "circuit.h"
 
+typedef struct yy_buffer_state *YY_BUFFER_STATE;
+
 extern	int	yyparse();
-extern	FILE	*yyin;
+extern	__thread FILE	*yyin;
+extern	__thread int	yylineno;
 extern	FILE	*output;
+extern	YY_BUFFER_STATE	yy_scan_buffer(char *base, size_t size);
+extern	void	yy_delete_buffer(YY_BUFFER_STATE buffer);
+extern	void	yyrestart(FILE *input_file);
+extern	int	yylex_destroy(void);
 
-void parse_file(char *vhdl_file) {
-  yyin = fopen(vhdl_file, "r");
-  if (yyin == 0) {
-      fprintf(stderr, "Could not open vhdl input file (%s)\n", vhdl_file);
-      exit(1);
-    }
+/* -b: also write the memory-mappable circuit_output.bin */
+int binary_output = 0;
 
-  init_circuit();
-  
-  printf("Parsing file: %s\n", vhdl_file);
+/* -f: try the hand-written parser for flat netlists before bison */
+int fast_parse_mode = 0;
+
+/* -j N: compile up to N files at once */
+int jobs = 1;
+
+/*
+ * Map a netlist so the scanner can run over it in place. The file is
+ * mapped copy-on-write on top of an anonymous region at least two bytes
+ * longer, so the two NUL bytes flex requires after an in-place buffer are
+ * already there. Returns NULL when the file cannot be mapped (not a
+ * regular file, empty), and the caller falls back to reading via yyin.
+ */
+static char *map_netlist (const char *path, size_t *file_size, size_t *map_size)
+{
+  struct stat st;
+  int fd = open (path, O_RDONLY);
+  if (fd < 0)
+    return NULL;
+  if (fstat (fd, &st) != 0 || !S_ISREG (st.st_mode) || st.st_size == 0) {
+      close (fd);
+      return NULL;
+  }
+
+  size_t page = (size_t) sysconf (_SC_PAGESIZE);
+  *file_size = (size_t) st.st_size;
+  *map_size = (*file_size + 2 + page - 1) / page * page;
+
+  char *base = mmap (NULL, *map_size, PROT_READ | PROT_WRITE,
+		     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (base == MAP_FAILED) {
+      close (fd);
+      return NULL;
+  }
+  if (mmap (base, *file_size, PROT_READ | PROT_WRITE,
+	    MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+      munmap (base, *map_size);
+      close (fd);
+      return NULL;
+  }
+  close (fd);
+
+  madvise (base, *file_size, MADV_SEQUENTIAL);
+  return base;
+}
+
+/*
+ * The bison parser is pure and the flex scanner's state is thread-local,
+ * so each thread runs the grammar over its own file without locking.
+ */
+static void parse_with_grammar (char *netlist, size_t file_size, FILE *input)
+{
+  YY_BUFFER_STATE buffer = NULL;
+
+  yylineno = 1;
+  if (netlist) {
+      buffer = yy_scan_buffer(netlist, file_size + 2);
+  } else {
+      yyin = input;
+      yyrestart(yyin);
+  }
   yyparse();
   resolve_dff_connections();
-  printf("\n");
+  if (buffer) {
+      /* identifiers were interned while scanning, nothing points into the map */
+      yy_delete_buffer(buffer);
+  }
+  /* frees this thread's buffer stack, a worker may not parse again */
+  yylex_destroy();
+}
+
+/* Returns 0, or -1 if the netlist cannot be read or the binary file written. */
+int compile_file(const char *vhdl_file, const char *text_file, const char *binary_file) {
+  int status = 0;
+  size_t file_size = 0, map_size = 0;
+  char *netlist = map_netlist(vhdl_file, &file_size, &map_size);
+  FILE *input = NULL;
+
+  if (!netlist) {
+      input = fopen(vhdl_file, "r");
+      if (input == 0) {
+          fprintf(stderr, "Could not open vhdl input file (%s)\n", vhdl_file);
+          return -1;
+      }
+  }
+
+  init_circuit();
   
-  fclose(yyin);
+  log_printf("Parsing file: %s\n", vhdl_file);
+  if (fast_parse_mode && netlist && fast_parse(netlist, file_size) == 0) {
+      log_printf("Parsed flat netlist with the fast path\n");
+  } else {
+      if (fast_parse_mode) {
+          /* the fast path gave up part way, start over with the grammar */
+          log_printf("Fast path not applicable, using the full parser\n");
+          free_circuit();
+          init_circuit();
+      }
+      parse_with_grammar(netlist, file_size, input);
+  }
+  build_csr();
+  log_printf("\n");
   
-  printf("Total gates after parsing: %d\n", circuit.gate_count);
-  printf("Inputs: %d, Outputs: %d, DFFs: %d\n\n", 
+  if (netlist) {
+      munmap(netlist, map_size);
+  } else {
+      fclose(input);
+  }
+  
+  log_printf("Total gates after parsing: %d\n", circuit.gate_count);
+  log_printf("Inputs: %d, Outputs: %d, DFFs: %d\n\n", 
          circuit.input_count, circuit.output_count, circuit.dff_count);
   
   assign_levels();
 
-  printf("\nBefore inserting buffers:\n");
-  for (int i = 0; i < circuit.gate_count; i++) {
-      if (strcmp(circuit.gates[i].name, "XG11") == 0) {
-          printf("XG11 fanouts: %d\n", circuit.gates[i].fanouts.count);
-          for (int j = 0; j < circuit.gates[i].fanouts.count; j++) {
-              printf("  -> %s\n", circuit.gates[circuit.gates[i].fanouts.items[j]].name);
-          }
+  log_printf("\nBefore inserting buffers:\n");
+  int xg11 = find_gate_by_name(find_symbol("XG11"));
+  if (xg11 >= 0) {
+      log_printf("XG11 fanouts: %d\n", gate_fanout_count(xg11));
+      for (int j = 0; j < gate_fanout_count(xg11); j++) {
+          log_printf("  -> %s\n", symbol_name(circuit.gates[gate_fanouts(xg11)[j]].name));
       }
   }
   insert_buffers();
-  assign_levels();
-  print_circuit();
+  print_circuit(text_file);
+  if (binary_output) {
+      status = write_circuit_binary(binary_file);
+  }
   free_circuit();
+  return status;
+}
+
+typedef struct CompileJob {
+  char *vhdl_file;
+  char *text_file;
+  char *binary_file;
+  char *log;			/* output captured by the worker */
+  size_t log_size;
+  int status;			/* compile_file's result */
+  int done;
+} CompileJob;
+
+static CompileJob *job_list;
+static int job_count;
+static int next_job;
+static pthread_mutex_t job_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t job_done = PTHREAD_COND_INITIALIZER;
+
+/*
+ * With a single input the intermediate files keep their usual names.
+ * With several, each input gets its own pair next to it, so s27.v
+ * compiles to s27_output.txt and s27_output.bin.
+ */
+static char *output_name (const char *vhdl_file, const char *suffix)
+{
+  const char *base = strrchr (vhdl_file, '/');
+  const char *dot = strrchr (base ? base : vhdl_file, '.');
+  size_t stem = dot ? (size_t) (dot - vhdl_file) : strlen (vhdl_file);
+  char *name = (char *) malloc (stem + strlen (suffix) + 1);
+
+  if (!name)
+    exit(1);
+  memcpy (name, vhdl_file, stem);
+  strcpy (name + stem, suffix);
+  return name;
+}
+
+/*
+ * Inputs that differ only in their extension (s27.v and s27.bench), or
+ * name the same file through different paths, would write the same
+ * intermediate files, at the same time under -j. The stems are compared
+ * with their directories resolved. Reports the first clash and returns 0.
+ */
+static int distinct_outputs (void)
+{
+  char **stems = (char **) malloc (job_count * sizeof (char *));
+  int ok = 1;
+
+  if (!stems)
+    exit(1);
+  for (int i = 0; i < job_count; i++) {
+      const char *file = job_list[i].vhdl_file;
+      const char *base = strrchr (file, '/');
+      char *dir = base ? strndup (file, base - file + 1) : strdup (".");
+      char *resolved = dir ? realpath (dir, NULL) : NULL;
+      char *path = (char *) malloc ((resolved ? strlen (resolved) : 0) + strlen (file) + 2);
+
+      if (!path)
+	exit(1);
+      if (resolved)
+	sprintf (path, "%s/%s", resolved, base ? base + 1 : file);
+      else
+	strcpy (path, file);
+      stems[i] = output_name (path, "");
+      free (path);
+      free (resolved);
+      free (dir);
+  }
+  for (int i = 1; i < job_count && ok; i++) {
+      for (int j = 0; j < i && ok; j++) {
+	  if (strcmp (stems[i], stems[j]) == 0) {
+	      fprintf (stderr, "%s and %s would both write %s\n",
+		       job_list[j].vhdl_file, job_list[i].vhdl_file, job_list[i].text_file);
+	      ok = 0;
+	  }
+      }
+  }
+  for (int i = 0; i < job_count; i++)
+    free (stems[i]);
+  free (stems);
+  return ok;
+}
+
+static void add_job (char *vhdl_file)
+{
+  job_list = (CompileJob *) realloc (job_list, (job_count + 1) * sizeof (CompileJob));
+  if (!job_list)
+    exit(1);
+  memset (&job_list[job_count], 0, sizeof (CompileJob));
+  job_list[job_count].vhdl_file = vhdl_file;
+  job_count++;
+}
+
+/* takes jobs in order until none are left, logging each to memory */
+static void *compile_worker (void *arg)
+{
+  (void) arg;
+  for (;;) {
+      pthread_mutex_lock (&job_lock);
+      int i = next_job++;
+      pthread_mutex_unlock (&job_lock);
+      if (i >= job_count)
+	return NULL;
+
+      CompileJob *job = &job_list[i];
+      circuit_log = open_memstream (&job->log, &job->log_size);
+      job->status = compile_file (job->vhdl_file, job->text_file, job->binary_file);
+      if (circuit_log) {
+	  fclose (circuit_log);
+	  circuit_log = NULL;
+      }
+
+      pthread_mutex_lock (&job_lock);
+      job->done = 1;
+      pthread_cond_broadcast (&job_done);
+      pthread_mutex_unlock (&job_lock);
+  }
+}
+
+/*
+ * Compile every queued file on up to `jobs` threads. Each worker has its
+ * own circuit, and the logs are printed in command-line order as the files
+ * finish, so the output reads the same as a sequential run. A file that
+ * fails does not stop the others. Returns 1 if any file failed, else 0.
+ */
+static int compile_jobs (int jobs)
+{
+  int failed = 0;
+
+  for (int i = 0; i < job_count; i++) {
+      if (job_count == 1) {
+	  job_list[i].text_file = strdup ("circuit_output.txt");
+	  job_list[i].binary_file = strdup ("circuit_output.bin");
+      } else {
+	  job_list[i].text_file = output_name (job_list[i].vhdl_file, "_output.txt");
+	  job_list[i].binary_file = output_name (job_list[i].vhdl_file, "_output.bin");
+      }
+  }
+
+  if (jobs > job_count)
+    jobs = job_count;
+  if (job_count > 1 && !distinct_outputs ()) {
+      failed = 1;
+  } else if (jobs <= 1) {
+      for (int i = 0; i < job_count; i++)
+	job_list[i].status = compile_file (job_list[i].vhdl_file, job_list[i].text_file, job_list[i].binary_file);
+  } else {
+      pthread_t *threads = (pthread_t *) malloc (jobs * sizeof (pthread_t));
+      if (!threads)
+	exit(1);
+      for (int t = 0; t < jobs; t++) {
+	  if (pthread_create (&threads[t], NULL, compile_worker, NULL) != 0) {
+	      fprintf (stderr, "Could not start compile thread\n");
+	      exit(1);
+	  }
+      }
+
+      for (int i = 0; i < job_count; i++) {
+	  CompileJob *job = &job_list[i];
+	  pthread_mutex_lock (&job_lock);
+	  while (!job->done)
+	    pthread_cond_wait (&job_done, &job_lock);
+	  pthread_mutex_unlock (&job_lock);
+	  if (job->log) {
+	      fwrite (job->log, 1, job->log_size, stdout);
+	      free (job->log);
+	  }
+      }
+
+      for (int t = 0; t < jobs; t++)
+	pthread_join (threads[t], NULL);
+      free (threads);
+  }
+
+  for (int i = 0; i < job_count; i++) {
+      if (job_list[i].status != 0)
+	failed = 1;
+      free (job_list[i].text_file);
+      free (job_list[i].binary_file);
+  }
+  free (job_list);
+  return failed;
 }
 
 char *program_path;
@@ -128,20 +419,30 @@ int main (argc, argv)
      char **argv;
 {
   char *op, *argv0;
-  int files;
 
   argv0 = argv[0];
   program_path = get_program_path (argv0);
 
   argv++;
-  files = 0;
   while (*argv) {
       op = *argv++;
       if (*op != '-') {
-	     parse_file (op);
-	     files++;
+	     add_job (op);
 	     continue;
 	  }
       op++;
+      if (strcmp (op, "b") == 0)
+	     binary_output = 1;
+      else if (strcmp (op, "f") == 0)
+	     fast_parse_mode = 1;
+      else if (*op == 'j') {
+	     char *count = op[1] ? op + 1 : *argv++;
+	     jobs = count ? atoi (count) : 0;
+	     if (jobs < 1) {
+		 fprintf (stderr, "-j needs a positive thread count\n");
+		 exit(1);
+	     }
+	  }
    }
-}
\ No newline at end of file
+  return compile_jobs (jobs);
+}
@@ -55,7 +55,7 @@
 #define YYSKELETON_NAME "yacc.c"
 
 /* Pure parsers.  */
-#define YYPURE 0
+#define YYPURE 2
 
 /* Push parsers.  */
 #define YYPUSH 0
@@ -77,17 +77,17 @@
 extern int yyerror();
 extern int yyparse();
 extern int yylex();
-extern int yylineno;
+extern __thread int yylineno;
 
-char current_gate_name[256];
-GateType current_gate_type;
-char *port_names[100];
-int port_count = 0;
+// The parser is pure and the scanner's state is thread-local (see
+// tokens.l), so each thread parses its own file with these.
+__thread Symbol current_gate_name;
+__thread GateType current_gate_type;
+__thread SymbolList port_names;
 
 // Store DFF connections for deferred resolution
-char *dff_d_inputs[100];
-char *dff_q_outputs[100];
-int dff_conn_count = 0;
+__thread SymbolList dff_d_inputs;
+__thread SymbolList dff_q_outputs;
 
 #define YYDEBUG 1
 
@@ -548,10 +548,10 @@ static const yytype_int8 yytranslate[] =
 /* YYRLINE[YYN] -- Source line where rule number YYN was defined.  */
 static const yytype_uint8 yyrline[] =
 {
-       0,    41,    41,    47,    48,    52,    59,    60,    64,    65,
-      66,    67,    68,    72,    78,    83,    91,    97,   100,   106,
-     110,   113,   119,   125,   125,   163,   167,   174,   177,   180,
-     183,   186,   189,   192,   195,   198
+       0,    49,    49,    55,    56,    60,    67,    68,    72,    73,
+      74,    75,    76,    80,    86,    90,    97,   103,   106,   112,
+     116,   119,   125,   131,   131,   169,   172,   178,   181,   184,
+     187,   190,   193,   196,   199,   202
 };
 #endif
 
@@ -893,13 +893,6 @@ yydestruct (const char *yymsg,
 }
 
 
-/* Lookahead token kind.  */
-int yychar;
-
-/* The semantic value of the lookahead symbol.  */
-YYSTYPE yylval;
-/* Number of syntax errors so far.  */
-int yynerrs;
 
 
 
@@ -911,6 +904,19 @@ int yynerrs;
 int
 yyparse (void)
 {
+/* Lookahead token kind.  */
+int yychar;
+
+
+/* The semantic value of the lookahead symbol.  */
+/* Default value used for initialization, for pacifying older GCCs
+   or non-GCC compilers.  */
+YY_INITIAL_VALUE (static YYSTYPE yyval_default;)
+YYSTYPE yylval YY_INITIAL_VALUE (= yyval_default);
+
+    /* Number of syntax errors so far.  */
+    int yynerrs = 0;
+
     yy_state_fast_t yystate = 0;
     /* Number of tokens to shift before error messages enabled.  */
     int yyerrstatus = 0;
@@ -1063,7 +1069,7 @@ yybackup:
   if (yychar == YYEMPTY)
     {
       YYDPRINTF ((stderr, "Reading a token\n"));
-      yychar = yylex ();
+      yychar = yylex (&yylval);
     }
 
   if (yychar <= YYEOF)
@@ -1151,110 +1157,107 @@ yyreduce:
   switch (yyn)
     {
   case 2: /* module: MODULE _NAME '(' port_list ')' ';' module_items ENDMODULE  */
-#line 41 "parse.y"
+#line 49 "parse.y"
                                                               {
-        printf("\nFinished parsing module.\n");
+        log_printf("\nFinished parsing module.\n");
     }
-#line 1159 "parse.tab.c"
+#line 1165 "parse.tab.c"
     break;
 
   case 5: /* port_ref: _NAME  */
-#line 52 "parse.y"
+#line 60 "parse.y"
           {
         /* Port names in module declaration - we don't need to process these */
         /* They'll be defined as inputs/outputs later */
     }
-#line 1168 "parse.tab.c"
+#line 1174 "parse.tab.c"
     break;
 
   case 13: /* input_declaration: INPUT input_list ';'  */
-#line 72 "parse.y"
+#line 80 "parse.y"
                          {
-        printf("Input declaration processed\n");
+        log_printf("Input declaration processed\n");
     }
-#line 1176 "parse.tab.c"
+#line 1182 "parse.tab.c"
     break;
 
   case 14: /* input_list: _NAME  */
-#line 78 "parse.y"
+#line 86 "parse.y"
           {
-        add_gate((yyvsp[0].id), GATE_INPUT);
-        int idx = circuit.gate_count - 1;
-        circuit.gates[idx].output_wire = strdup((yyvsp[0].id));
+        add_gate((yyvsp[0].sym), GATE_INPUT);
+        set_gate_output_wire(circuit.gate_count - 1, (yyvsp[0].sym));
     }
-#line 1186 "parse.tab.c"
+#line 1191 "parse.tab.c"
     break;
 
   case 15: /* input_list: input_list ',' _NAME  */
-#line 83 "parse.y"
+#line 90 "parse.y"
                            {
-        add_gate((yyvsp[0].id), GATE_INPUT);
-        int idx = circuit.gate_count - 1;
-        circuit.gates[idx].output_wire = strdup((yyvsp[0].id));
+        add_gate((yyvsp[0].sym), GATE_INPUT);
+        set_gate_output_wire(circuit.gate_count - 1, (yyvsp[0].sym));
     }
-#line 1196 "parse.tab.c"
+#line 1200 "parse.tab.c"
     break;
 
   case 16: /* output_declaration: OUTPUT output_list ';'  */
-#line 91 "parse.y"
+#line 97 "parse.y"
                            {
-        printf("Output declaration processed\n");
+        log_printf("Output declaration processed\n");
     }
-#line 1204 "parse.tab.c"
+#line 1208 "parse.tab.c"
     break;
 
   case 17: /* output_list: _NAME  */
-#line 97 "parse.y"
+#line 103 "parse.y"
           {
-        set_gate_as_output((yyvsp[0].id));
+        set_gate_as_output((yyvsp[0].sym));
     }
-#line 1212 "parse.tab.c"
+#line 1216 "parse.tab.c"
     break;
 
   case 18: /* output_list: output_list ',' _NAME  */
-#line 100 "parse.y"
+#line 106 "parse.y"
                             {
-        set_gate_as_output((yyvsp[0].id));
+        set_gate_as_output((yyvsp[0].sym));
     }
-#line 1220 "parse.tab.c"
+#line 1224 "parse.tab.c"
     break;
 
   case 20: /* wire_list: _NAME  */
-#line 110 "parse.y"
+#line 116 "parse.y"
           {
         /* Wire declarations - just ignore them */
     }
-#line 1228 "parse.tab.c"
+#line 1232 "parse.tab.c"
     break;
 
   case 21: /* wire_list: wire_list ',' _NAME  */
-#line 113 "parse.y"
+#line 119 "parse.y"
                           {
         /* Wire declarations - just ignore them */
     }
-#line 1236 "parse.tab.c"
+#line 1240 "parse.tab.c"
     break;
 
   case 22: /* net_type: WIRE  */
-#line 119 "parse.y"
+#line 125 "parse.y"
          {
-        printf("Wire declaration\n");
+        log_printf("Wire declaration\n");
     }
-#line 1244 "parse.tab.c"
+#line 1248 "parse.tab.c"
     break;
 
   case 23: /* $@1: %empty  */
-#line 125 "parse.y"
+#line 131 "parse.y"
                     {
-        strncpy(current_gate_name, (yyvsp[0].id), 255);
-        current_gate_name[255] = '\0';
-        port_count = 0;
+        current_gate_name = (yyvsp[0].sym);
+        port_names.count = 0;
     }
-#line 1254 "parse.tab.c"
+#line 1257 "parse.tab.c"
     break;
 
   case 24: /* gate_instantiation: gate_type _NAME $@1 '(' gate_port_list ')' ';'  */
-#line 129 "parse.y"
+#line 134 "parse.y"
                                  {
         
         /* Create the gate */
@@ -1262,125 +1265,124 @@ yyreduce:
         int gate_idx = circuit.gate_count - 1;
         
         /* Store output wire name */
+        Symbol *ports = port_names.items;
+        int port_count = port_names.count;
         if (port_count > 0) {
             if (current_gate_type == GATE_DFF) {
                 // DFF: port[0] is Q (output), port[1] is D (input)
-                circuit.gates[gate_idx].output_wire = strdup(port_names[0]);
+                set_gate_output_wire(gate_idx, ports[0]);
                 
                 // Store D connection for later (after all gates are parsed)
                 if (port_count >= 2) {
-                    dff_d_inputs[dff_conn_count] = strdup(port_names[1]);
-                    dff_q_outputs[dff_conn_count] = strdup(port_names[0]);
-                    dff_conn_count++;
+                    add_to_symbollist(&dff_d_inputs, ports[1]);
+                    add_to_symbollist(&dff_q_outputs, ports[0]);
                 }
             } else {
                 // Regular gates: port[0] is output, rest are inputs
-                circuit.gates[gate_idx].output_wire = strdup(port_names[0]);
+                set_gate_output_wire(gate_idx, ports[0]);
                 
                 // Connect inputs to this gate's output
                 for (int i = 1; i < port_count; i++) {
-                    add_connection(port_names[i], port_names[0]);
+                    add_connection(ports[i], ports[0]);
                 }
             }
         }
         
-        port_count = 0;
+        port_names.count = 0;
     }
-#line 1290 "parse.tab.c"
+#line 1294 "parse.tab.c"
     break;
 
   case 25: /* gate_port_list: _NAME  */
-#line 163 "parse.y"
+#line 169 "parse.y"
           {
-        port_names[port_count] = strdup((yyvsp[0].id));  // MAKE A COPY
-        port_count++;
+        add_to_symbollist(&port_names, (yyvsp[0].sym));
     }
-#line 1299 "parse.tab.c"
+#line 1302 "parse.tab.c"
     break;
 
   case 26: /* gate_port_list: gate_port_list ',' _NAME  */
-#line 167 "parse.y"
+#line 172 "parse.y"
                                {
-        port_names[port_count] = strdup((yyvsp[0].id));  // MAKE A COPY
-        port_count++;
+        add_to_symbollist(&port_names, (yyvsp[0].sym));
     }
-#line 1308 "parse.tab.c"
+#line 1310 "parse.tab.c"
     break;
 
   case 27: /* gate_type: AND  */
-#line 174 "parse.y"
+#line 178 "parse.y"
         {
         current_gate_type = GATE_AND;
     }
-#line 1316 "parse.tab.c"
+#line 1318 "parse.tab.c"
     break;
 
   case 28: /* gate_type: NAND  */
-#line 177 "parse.y"
+#line 181 "parse.y"
            {
         current_gate_type = GATE_NAND;
     }
-#line 1324 "parse.tab.c"
+#line 1326 "parse.tab.c"
     break;
 
   case 29: /* gate_type: OR  */
-#line 180 "parse.y"
+#line 184 "parse.y"
          {
         current_gate_type = GATE_OR;
     }
-#line 1332 "parse.tab.c"
+#line 1334 "parse.tab.c"
     break;
 
   case 30: /* gate_type: NOR  */
-#line 183 "parse.y"
+#line 187 "parse.y"
           {
         current_gate_type = GATE_NOR;
     }
-#line 1340 "parse.tab.c"
+#line 1342 "parse.tab.c"
     break;
 
   case 31: /* gate_type: XOR  */
-#line 186 "parse.y"
+#line 190 "parse.y"
           {
         current_gate_type = GATE_XOR;
     }
-#line 1348 "parse.tab.c"
+#line 1350 "parse.tab.c"
     break;
 
   case 32: /* gate_type: XNOR  */
-#line 189 "parse.y"
+#line 193 "parse.y"
            {
         current_gate_type = GATE_XNOR;
     }
-#line 1356 "parse.tab.c"
+#line 1358 "parse.tab.c"
     break;
 
   case 33: /* gate_type: BUF  */
-#line 192 "parse.y"
+#line 196 "parse.y"
           {
         current_gate_type = GATE_BUF;
     }
-#line 1364 "parse.tab.c"
+#line 1366 "parse.tab.c"
     break;
 
   case 34: /* gate_type: NOT  */
-#line 195 "parse.y"
+#line 199 "parse.y"
           {
         current_gate_type = GATE_NOT;
     }
-#line 1372 "parse.tab.c"
+#line 1374 "parse.tab.c"
     break;
 
   case 35: /* gate_type: DFF  */
-#line 198 "parse.y"
+#line 202 "parse.y"
           {
         current_gate_type = GATE_DFF;
     }
-#line 1380 "parse.tab.c"
+#line 1382 "parse.tab.c"
     break;
 
 
-#line 1384 "parse.tab.c"
+#line 1386 "parse.tab.c"
 
       default: break;
     }
@@ -1573,23 +1575,27 @@ yyreturnlab:
   return yyresult;
 }
 
-#line 203 "parse.y"
+#line 207 "parse.y"
 
 
-extern char *yytext;
+extern __thread char *yytext;
 
 int yyerror(const char *s) {
-    printf("line %d: '%s' near '%s'\n", yylineno, s, yytext);
+    log_printf("line %d: '%s' near '%s'\n", yylineno, s, yytext);
     return 0;
 }
 
+// Called once the whole module is parsed, when every D input's driver is
+// known. Each deferred connection is a constant-time lookup, and the parser
+// lists are released here since they are not needed past this point.
 void resolve_dff_connections(void) {
-    printf("Resolving %d DFF connections...\n", dff_conn_count);
-    for (int i = 0; i < dff_conn_count; i++) {
-        printf("  Connecting DFF: %s -> %s\n", dff_d_inputs[i], dff_q_outputs[i]);
-        add_connection(dff_d_inputs[i], dff_q_outputs[i]);
-        free(dff_d_inputs[i]);
-        free(dff_q_outputs[i]);
+    log_printf("Resolving %d DFF connections...\n", dff_d_inputs.count);
+    for (int i = 0; i < dff_d_inputs.count; i++) {
+        log_printf("  Connecting DFF: %s -> %s\n",
+               symbol_name(dff_d_inputs.items[i]), symbol_name(dff_q_outputs.items[i]));
+        add_connection(dff_d_inputs.items[i], dff_q_outputs.items[i]);
     }
-    dff_conn_count = 0;
+    free_symbollist(&dff_d_inputs);
+    free_symbollist(&dff_q_outputs);
+    free_symbollist(&port_names);
 }
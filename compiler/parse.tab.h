@@ -44,6 +44,12 @@
 #if YYDEBUG
 extern int yydebug;
 #endif
+/* "%code requires" blocks.  */
+#line 29 "parse.y"
+
+#include "circuit.h"
+
+#line 53 "parse.tab.h"
 
 /* Token kinds.  */
 #ifndef YYTOKENTYPE
@@ -80,12 +86,13 @@ extern int yydebug;
 #if ! defined YYSTYPE && ! defined YYSTYPE_IS_DECLARED
 union YYSTYPE
 {
-#line 27 "parse.y"
+#line 33 "parse.y"
 
     char *id;
+    Symbol sym;
     unsigned long ln;
 
-#line 89 "parse.tab.h"
+#line 96 "parse.tab.h"
 
 };
 typedef union YYSTYPE YYSTYPE;
@@ -94,7 +101,6 @@ typedef union YYSTYPE YYSTYPE;
 #endif
 
 
-extern YYSTYPE yylval;
 
 
 int yyparse (void);
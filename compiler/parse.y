@@ -7,31 +7,39 @@
 extern int yyerror();
 extern int yyparse();
 extern int yylex();
-extern int yylineno;
+extern __thread int yylineno;
 
-char current_gate_name[256];
-GateType current_gate_type;
-char *port_names[100];
-int port_count = 0;
+// The parser is pure and the scanner's state is thread-local (see
+// tokens.l), so each thread parses its own file with these.
+__thread Symbol current_gate_name;
+__thread GateType current_gate_type;
+__thread SymbolList port_names;
 
 // Store DFF connections for deferred resolution
-char *dff_d_inputs[100];
-char *dff_q_outputs[100];
-int dff_conn_count = 0;
+__thread SymbolList dff_d_inputs;
+__thread SymbolList dff_q_outputs;
 
 #define YYDEBUG 1
 %}
 
 %start module
 
+%define api.pure full
+
+%code requires {
+#include "circuit.h"
+}
+
 %union {
     char *id;
+    Symbol sym;
     unsigned long ln;
 }
 
 %token NAND WIRE AND OR NOR XOR XNOR BUF NOT DFF OUTPUT INPUT MODULE ENDMODULE 
 
-%token <id> _NAME _STRING
+%token <sym> _NAME
+%token <id> _STRING
 %token <ln> _NUMBER
 %token <ln> _BASENUMBER
 
@@ -39,7 +47,7 @@ int dff_conn_count = 0;
 
 module: 
     MODULE _NAME '(' port_list ')' ';' module_items ENDMODULE {
-        printf("\nFinished parsing module.\n");
+        log_printf("\nFinished parsing module.\n");
     }
     ;
 
@@ -70,26 +78,24 @@ module_item:
 
 input_declaration: 
     INPUT input_list ';' {
-        printf("Input declaration processed\n");
+        log_printf("Input declaration processed\n");
     }
     ;
 
 input_list:
     _NAME {
         add_gate($1, GATE_INPUT);
-        int idx = circuit.gate_count - 1;
-        circuit.gates[idx].output_wire = strdup($1);
+        set_gate_output_wire(circuit.gate_count - 1, $1);
     }
     | input_list ',' _NAME {
         add_gate($3, GATE_INPUT);
-        int idx = circuit.gate_count - 1;
-        circuit.gates[idx].output_wire = strdup($3);
+        set_gate_output_wire(circuit.gate_count - 1, $3);
     }
     ;
 
 output_declaration: 
     OUTPUT output_list ';' {
-        printf("Output declaration processed\n");
+        log_printf("Output declaration processed\n");
     }
     ;
 
@@ -117,15 +123,14 @@ wire_list:
 
 net_type: 
     WIRE {
-        printf("Wire declaration\n");
+        log_printf("Wire declaration\n");
     }
     ;
 
 gate_instantiation:
     gate_type _NAME {
-        strncpy(current_gate_name, $2, 255);
-        current_gate_name[255] = '\0';
-        port_count = 0;
+        current_gate_name = $2;
+        port_names.count = 0;
     } '(' gate_port_list ')' ';' {
         
         /* Create the gate */
@@ -133,40 +138,39 @@ gate_instantiation:
         int gate_idx = circuit.gate_count - 1;
         
         /* Store output wire name */
+        Symbol *ports = port_names.items;
+        int port_count = port_names.count;
         if (port_count > 0) {
             if (current_gate_type == GATE_DFF) {
                 // DFF: port[0] is Q (output), port[1] is D (input)
-                circuit.gates[gate_idx].output_wire = strdup(port_names[0]);
+                set_gate_output_wire(gate_idx, ports[0]);
                 
                 // Store D connection for later (after all gates are parsed)
                 if (port_count >= 2) {
-                    dff_d_inputs[dff_conn_count] = strdup(port_names[1]);
-                    dff_q_outputs[dff_conn_count] = strdup(port_names[0]);
-                    dff_conn_count++;
+                    add_to_symbollist(&dff_d_inputs, ports[1]);
+                    add_to_symbollist(&dff_q_outputs, ports[0]);
                 }
             } else {
                 // Regular gates: port[0] is output, rest are inputs
-                circuit.gates[gate_idx].output_wire = strdup(port_names[0]);
+                set_gate_output_wire(gate_idx, ports[0]);
                 
                 // Connect inputs to this gate's output
                 for (int i = 1; i < port_count; i++) {
-                    add_connection(port_names[i], port_names[0]);
+                    add_connection(ports[i], ports[0]);
                 }
             }
         }
         
-        port_count = 0;
+        port_names.count = 0;
     }
     ;
 
 gate_port_list:
     _NAME {
-        port_names[port_count] = strdup($1);  // MAKE A COPY
-        port_count++;
+        add_to_symbollist(&port_names, $1);
     }
     | gate_port_list ',' _NAME {
-        port_names[port_count] = strdup($3);  // MAKE A COPY
-        port_count++;
+        add_to_symbollist(&port_names, $3);
     }
     ;
 
@@ -202,20 +206,24 @@ gate_type:
 
 %%
 
-extern char *yytext;
+extern __thread char *yytext;
 
 int yyerror(const char *s) {
-    printf("line %d: '%s' near '%s'\n", yylineno, s, yytext);
+    log_printf("line %d: '%s' near '%s'\n", yylineno, s, yytext);
     return 0;
 }
 
+// Called once the whole module is parsed, when every D input's driver is
+// known. Each deferred connection is a constant-time lookup, and the parser
+// lists are released here since they are not needed past this point.
 void resolve_dff_connections(void) {
-    printf("Resolving %d DFF connections...\n", dff_conn_count);
-    for (int i = 0; i < dff_conn_count; i++) {
-        printf("  Connecting DFF: %s -> %s\n", dff_d_inputs[i], dff_q_outputs[i]);
-        add_connection(dff_d_inputs[i], dff_q_outputs[i]);
-        free(dff_d_inputs[i]);
-        free(dff_q_outputs[i]);
-    }
-    dff_conn_count = 0;
+    log_printf("Resolving %d DFF connections...\n", dff_d_inputs.count);
+    for (int i = 0; i < dff_d_inputs.count; i++) {
+        log_printf("  Connecting DFF: %s -> %s\n",
+               symbol_name(dff_d_inputs.items[i]), symbol_name(dff_q_outputs.items[i]));
+        add_connection(dff_d_inputs.items[i], dff_q_outputs.items[i]);
+    }
+    free_symbollist(&dff_d_inputs);
+    free_symbollist(&dff_q_outputs);
+    free_symbollist(&port_names);
 }
\ No newline at end of file
@@ -0,0 +1,298 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "simulator.h"
+
+/*
+ * Levelized bytecode simulation. The circuit arrays are lowered once into a
+ * flat instruction stream in level order (see BytecodeOp), and every cycle
+ * runs the whole stream without any event scheduling. Signals are one byte
+ * each, and the stream keeps each gate's fanins next to it. With GCC
+ * the interpreter uses threaded dispatch (a computed goto at the end of
+ * every handler); other compilers get a plain switch loop.
+ */
+
+// filled by init_lookup_tables
+extern LogicValue not_table[3];
+extern LogicValue and_table[3][3];
+extern LogicValue or_table[3][3];
+extern LogicValue xor_table[3][3];
+
+// byte copies of the gate tables, indexed by opcode - BC_AND2 (or - BC_AND)
+static uint8_t bc_tables[6][3][3];
+static uint8_t bc_not[3];
+
+static void init_bytecode_tables(void) {
+    for (int a = 0; a < 3; a++) {
+        bc_not[a] = not_table[a];
+        for (int b = 0; b < 3; b++) {
+            bc_tables[0][a][b] = and_table[a][b];
+            bc_tables[1][a][b] = not_table[and_table[a][b]];
+            bc_tables[2][a][b] = or_table[a][b];
+            bc_tables[3][a][b] = not_table[or_table[a][b]];
+            bc_tables[4][a][b] = xor_table[a][b];
+            bc_tables[5][a][b] = not_table[xor_table[a][b]];
+        }
+    }
+}
+
+// appends the instruction for one gate, returns the new end of the stream
+static int32_t* lower_gate(int32_t* pc, const Simulator* sim, int id) {
+    const int* fanins = sim_fanins(sim, id);
+    int n = sim_fanin_count(sim, id);
+    int op;
+
+    switch (sim->type[id]) {
+        case GATE_AND:  op = BC_AND; break;
+        case GATE_NAND: op = BC_NAND; break;
+        case GATE_OR:   op = BC_OR; break;
+        case GATE_NOR:  op = BC_NOR; break;
+        case GATE_XOR:  op = BC_XOR; break;
+        case GATE_XNOR: op = BC_XNOR; break;
+        case GATE_BUF:
+        case GATE_WIRE:
+            *pc++ = BC_BUF;
+            *pc++ = id;
+            *pc++ = fanins[0];
+            return pc;
+        case GATE_NOT:
+            *pc++ = BC_NOT;
+            *pc++ = id;
+            *pc++ = fanins[0];
+            return pc;
+        default:
+            *pc++ = BC_X;
+            *pc++ = id;
+            return pc;
+    }
+
+    // a one-input gate is a buffer, or an inverter for the negated types
+    if (n == 1) {
+        int inverted = (op == BC_NAND || op == BC_NOR || op == BC_XNOR);
+        *pc++ = inverted ? BC_NOT : BC_BUF;
+        *pc++ = id;
+        *pc++ = fanins[0];
+        return pc;
+    }
+    if (n == 2) {
+        *pc++ = op - BC_AND + BC_AND2;
+        *pc++ = id;
+        *pc++ = fanins[0];
+        *pc++ = fanins[1];
+        return pc;
+    }
+
+    *pc++ = op;
+    *pc++ = id;
+    *pc++ = n;
+    for (int i = 0; i < n; i++) {
+        *pc++ = fanins[i];
+    }
+    return pc;
+}
+
+void init_bytecode_sim(BytecodeSim* bs, Simulator* sim) {
+    init_bytecode_tables();
+
+    int* order = (int*)malloc((sim->gate_count + 1) * sizeof(int));
+    if (!order) {
+        exit(1);
+    }
+    int order_count = level_order(sim, order);
+
+    // at most op, out, n and the fanins per gate, plus the halt
+    size_t words = 1;
+    for (int i = 0; i < order_count; i++) {
+        words += 3 + sim_fanin_count(sim, order[i]);
+    }
+
+    bs->sim = sim;
+    bs->code = (int32_t*)malloc(words * sizeof(int32_t));
+    bs->values = (uint8_t*)malloc(sim->gate_count + 1);
+    bs->next_dff = (uint8_t*)malloc(sim->dff_count + 1);
+    if (!bs->code || !bs->values || !bs->next_dff) {
+        exit(1);
+    }
+
+    int32_t* pc = bs->code;
+    for (int i = 0; i < order_count; i++) {
+        pc = lower_gate(pc, sim, order[i]);
+    }
+    *pc++ = BC_HALT;
+    bs->code_size = (int)(pc - bs->code);
+    free(order);
+
+    // all X
+    memset(bs->values, VALUE_X, sim->gate_count + 1);
+    memset(bs->next_dff, VALUE_X, sim->dff_count + 1);
+}
+
+void free_bytecode_sim(BytecodeSim* bs) {
+    free(bs->code);
+    free(bs->values);
+    free(bs->next_dff);
+    bs->code = NULL;
+    bs->values = NULL;
+    bs->next_dff = NULL;
+    bs->code_size = 0;
+}
+
+#if defined(__GNUC__)
+#define BC_THREADED 1
+#endif
+
+#ifdef BC_THREADED
+#define BC_CASE(op) L_##op:
+#define BC_NEXT goto *dispatch[*pc]
+#else
+#define BC_CASE(op) case op:
+#define BC_NEXT continue
+#endif
+
+#define BC_OP2(op) \
+    BC_CASE(op) \
+        v[pc[1]] = bc_tables[op - BC_AND2][v[pc[2]]][v[pc[3]]]; \
+        pc += 4; \
+        BC_NEXT;
+
+// n inputs: fold with the positive table, then invert once if needed
+#define BC_OPN(op, base, inverted) \
+    BC_CASE(op) { \
+        int n = pc[2]; \
+        uint8_t r = v[pc[3]]; \
+        for (int i = 1; i < n; i++) { \
+            r = bc_tables[base][r][v[pc[3 + i]]]; \
+        } \
+        v[pc[1]] = (inverted) ? bc_not[r] : r; \
+        pc += 3 + n; \
+        BC_NEXT; \
+    }
+
+// runs the stream once over values
+static void run_bytecode(const int32_t* code, uint8_t* restrict v) {
+    const int32_t* pc = code;
+
+#ifdef BC_THREADED
+    static void* const dispatch[BC_OP_COUNT] = {
+        [BC_AND2] = &&L_BC_AND2, [BC_NAND2] = &&L_BC_NAND2,
+        [BC_OR2] = &&L_BC_OR2, [BC_NOR2] = &&L_BC_NOR2,
+        [BC_XOR2] = &&L_BC_XOR2, [BC_XNOR2] = &&L_BC_XNOR2,
+        [BC_AND] = &&L_BC_AND, [BC_NAND] = &&L_BC_NAND,
+        [BC_OR] = &&L_BC_OR, [BC_NOR] = &&L_BC_NOR,
+        [BC_XOR] = &&L_BC_XOR, [BC_XNOR] = &&L_BC_XNOR,
+        [BC_BUF] = &&L_BC_BUF, [BC_NOT] = &&L_BC_NOT,
+        [BC_X] = &&L_BC_X, [BC_HALT] = &&L_BC_HALT,
+    };
+    BC_NEXT;
+#else
+    for (;;) switch (*pc) {
+#endif
+
+    BC_OP2(BC_AND2)
+    BC_OP2(BC_NAND2)
+    BC_OP2(BC_OR2)
+    BC_OP2(BC_NOR2)
+    BC_OP2(BC_XOR2)
+    BC_OP2(BC_XNOR2)
+
+    BC_OPN(BC_AND, 0, 0)
+    BC_OPN(BC_NAND, 0, 1)
+    BC_OPN(BC_OR, 2, 0)
+    BC_OPN(BC_NOR, 2, 1)
+    BC_OPN(BC_XOR, 4, 0)
+    BC_OPN(BC_XNOR, 4, 1)
+
+    BC_CASE(BC_BUF)
+        v[pc[1]] = v[pc[2]];
+        pc += 3;
+        BC_NEXT;
+    BC_CASE(BC_NOT)
+        v[pc[1]] = bc_not[v[pc[2]]];
+        pc += 3;
+        BC_NEXT;
+    BC_CASE(BC_X)
+        v[pc[1]] = VALUE_X;
+        pc += 2;
+        BC_NEXT;
+    BC_CASE(BC_HALT)
+        return;
+
+#ifndef BC_THREADED
+    default:
+        return;
+    }
+#endif
+}
+
+// One clock: DFFs take their next state, every gate is evaluated once in
+// level order, and the D inputs are latched again.
+void bytecode_step(BytecodeSim* bs) {
+    Simulator* sim = bs->sim;
+    for (int i = 0; i < sim->dff_count; i++) {
+        bs->values[sim->dff_indices[i]] = bs->next_dff[i];
+    }
+
+    run_bytecode(bs->code, bs->values);
+
+    for (int i = 0; i < sim->dff_count; i++) {
+        int dff = sim->dff_indices[i];
+        if (sim_fanin_count(sim, dff) > 0) {
+            bs->next_dff[i] = bs->values[sim_fanins(sim, dff)[0]];
+        }
+    }
+}
+
+// copies the printed signals back into sim->state for print_state
+static void sync_printed_state(BytecodeSim* bs) {
+    Simulator* sim = bs->sim;
+    const int* lists[3] = { sim->input_indices, sim->output_indices, sim->dff_indices };
+    int counts[3] = { sim->input_count, sim->output_count, sim->dff_count };
+    for (int k = 0; k < 3; k++) {
+        for (int i = 0; i < counts[k]; i++) {
+            int id = lists[k][i];
+            sim_set_state(sim, id, (LogicValue)bs->values[id]);
+        }
+    }
+}
+
+// Same cycle loop and output as simulate().
+void simulate_bytecode(Simulator* sim, SimIO* io) {
+    BytecodeSim bs;
+    init_bytecode_sim(&bs, sim);
+
+    const uint8_t* inputs;
+    int cycle = 0;
+
+    clock_t start_time = clock();
+
+    while (1) {
+        if (!io->no_states) {
+            sync_printed_state(&bs);
+        }
+        sim_io_state(io, sim, cycle);
+
+        sim_io_prompt(io);
+        int input_count = sim_io_next(io, &inputs);
+        if (input_count < 0) {
+            break;
+        }
+
+        for (int i = 0; i < input_count; i++) {
+            bs.values[sim->input_indices[i]] = inputs[i];
+        }
+
+        bytecode_step(&bs);
+
+        cycle++;
+    }
+
+    clock_t end_time = clock();
+    double cpu_time = ((double)(end_time - start_time)) / CLOCKS_PER_SEC;
+
+    if (sim_io_report(io, cycle, cpu_time)) {
+        printf("Method: Levelized Bytecode (%d words)\n", bs.code_size);
+    }
+
+    free_bytecode_sim(&bs);
+}
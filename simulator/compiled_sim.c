@@ -0,0 +1,359 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include <dlfcn.h>
+#include <spawn.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "simulator.h"
+
+extern char** environ;
+
+/*
+ * Compiled-code simulation. The levelized circuit is translated into
+ * straight-line C, one statement per gate, with every signal held
+ * dual-rail in two flat byte arrays (h[i] = 1 when gate i is 1, l[i] = 1
+ * when it is 0, both 0 for X). The source is built into a shared object
+ * with the system compiler and loaded with dlopen. Objects are cached by
+ * a hash of the generated source, so a circuit is only compiled once.
+ *
+ * Every gate is evaluated every cycle in level order, which gives the
+ * same values as the event-driven loop in simulate().
+ */
+
+// bump when the generated code changes meaning, so old objects are not reused
+#define COMPILED_ABI "verilyzer-compiled-1"
+
+// gates per generated function; keeps each function small enough for the
+// C compiler to optimize in reasonable time
+#define COMPILED_CHUNK 2048
+
+typedef void (*compiled_eval_fn)(unsigned char* h, unsigned char* l);
+
+static unsigned long long hash_text(const char* s, size_t len) {
+    unsigned long long h = 1469598103934665603ULL;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)s[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+static void emit_gate(FILE* out, const Simulator* sim, int id) {
+    const int* f = sim_fanins(sim, id);
+    int n = sim_fanin_count(sim, id);
+    GateType type = (GateType)sim->type[id];
+
+    // NAND/NOR/XNOR/NOT are their positive form with the rails swapped
+    int inverted = (type == GATE_NAND || type == GATE_NOR ||
+                    type == GATE_XNOR || type == GATE_NOT);
+    char hi = inverted ? 'l' : 'h';
+    char lo = inverted ? 'h' : 'l';
+
+    switch (type) {
+        case GATE_AND:
+        case GATE_NAND:
+        case GATE_OR:
+        case GATE_NOR: {
+            // AND: 1 when all are 1, 0 when any is 0; OR the other way round
+            int is_and = (type == GATE_AND || type == GATE_NAND);
+            fprintf(out, "    %c[%d] = ", hi, id);
+            for (int i = 0; i < n; i++) {
+                fprintf(out, "%sh[%d]", i ? (is_and ? " & " : " | ") : "", f[i]);
+            }
+            fprintf(out, ";\n    %c[%d] = ", lo, id);
+            for (int i = 0; i < n; i++) {
+                fprintf(out, "%sl[%d]", i ? (is_and ? " | " : " & ") : "", f[i]);
+            }
+            fprintf(out, ";\n");
+            break;
+        }
+        case GATE_XOR:
+        case GATE_XNOR:
+            fprintf(out, "    { unsigned char th = h[%d], tl = l[%d], t;\n", f[0], f[0]);
+            for (int i = 1; i < n; i++) {
+                fprintf(out, "      t = (th & l[%d]) | (tl & h[%d]); tl = (th & h[%d]) | (tl & l[%d]); th = t;\n",
+                        f[i], f[i], f[i], f[i]);
+            }
+            fprintf(out, "      %c[%d] = th; %c[%d] = tl; }\n", hi, id, lo, id);
+            break;
+        case GATE_BUF:
+        case GATE_WIRE:
+        case GATE_NOT:
+            fprintf(out, "    %c[%d] = h[%d]; %c[%d] = l[%d];\n", hi, id, f[0], lo, id, f[0]);
+            break;
+        default:
+            fprintf(out, "    h[%d] = 0; l[%d] = 0;\n", id, id);
+            break;
+    }
+}
+
+// writes the whole translation unit; circuit_eval() runs one sweep
+static void emit_circuit(FILE* out, Simulator* sim, const int* order, int order_count) {
+    fprintf(out, "/* generated by circuit_simulator (%s), do not edit */\n", COMPILED_ABI);
+    fprintf(out, "/* %d gates, %d levels */\n\n", sim->gate_count, sim->max_level + 1);
+
+    int chunks = 0;
+    for (int start = 0; start < order_count; start += COMPILED_CHUNK, chunks++) {
+        int end = start + COMPILED_CHUNK < order_count ? start + COMPILED_CHUNK : order_count;
+        fprintf(out, "static void eval_%d(unsigned char* restrict h, unsigned char* restrict l) {\n", chunks);
+        for (int i = start; i < end; i++) {
+            emit_gate(out, sim, order[i]);
+        }
+        fprintf(out, "}\n\n");
+    }
+
+    fprintf(out, "void circuit_eval(unsigned char* restrict h, unsigned char* restrict l) {\n");
+    for (int i = 0; i < chunks; i++) {
+        fprintf(out, "    eval_%d(h, l);\n", i);
+    }
+    fprintf(out, "}\n");
+}
+
+// $VERILYZER_CACHE, else $XDG_CACHE_HOME/verilyzer, else ~/.cache/verilyzer
+static void cache_dir(char* buf, size_t size) {
+    const char* dir = getenv("VERILYZER_CACHE");
+    if (dir && *dir) {
+        snprintf(buf, size, "%s", dir);
+        mkdir(buf, 0755);
+        return;
+    }
+    dir = getenv("XDG_CACHE_HOME");
+    if (dir && *dir) {
+        snprintf(buf, size, "%s/verilyzer", dir);
+    } else if ((dir = getenv("HOME")) && *dir) {
+        snprintf(buf, size, "%s/.cache", dir);
+        mkdir(buf, 0755);
+        snprintf(buf, size, "%s/.cache/verilyzer", dir);
+    } else {
+        snprintf(buf, size, "/tmp/verilyzer-cache");
+    }
+    mkdir(buf, 0755);
+}
+
+// Runs "cc cflags -o object c_file" without a shell, so the cache paths
+// reach the compiler as they are, quotes and all. cc may carry its own
+// options ("gcc -m64"); it and cflags are split on blanks. Returns 1 if
+// the compiler exits with status 0.
+static int run_compiler(const char* cc, const char* cflags, const char* object, const char* c_file) {
+    char* words = (char*)malloc(strlen(cc) + strlen(cflags) + 2);
+    char** argv = (char**)malloc((strlen(cc) + strlen(cflags) + 8) * sizeof(char*));
+    if (!words || !argv) {
+        exit(1);
+    }
+    sprintf(words, "%s %s", cc, cflags);
+
+    int argc = 0;
+    char* save = NULL;
+    for (char* w = strtok_r(words, " \t", &save); w; w = strtok_r(NULL, " \t", &save)) {
+        argv[argc++] = w;
+    }
+    int ok = 0;
+    if (argc > 0) {
+        argv[argc++] = "-o";
+        argv[argc++] = (char*)object;
+        argv[argc++] = (char*)c_file;
+        argv[argc] = NULL;
+
+        pid_t pid;
+        int status;
+        if (posix_spawnp(&pid, argv[0], NULL, NULL, argv, environ) == 0) {
+            pid_t r;
+            while ((r = waitpid(pid, &status, 0)) == -1 && errno == EINTR) {
+            }
+            ok = r == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+        }
+    }
+    free(words);
+    free(argv);
+    return ok;
+}
+
+// Returns the path of the shared object for this circuit, building it
+// first if it is not cached yet. NULL if the compiler fails.
+static char* build_object(Simulator* sim, const int* order, int order_count, int* cached) {
+    char* source = NULL;
+    size_t source_size = 0;
+    FILE* out = open_memstream(&source, &source_size);
+    if (!out) {
+        return NULL;
+    }
+    emit_circuit(out, sim, order, order_count);
+    fclose(out);
+
+    const char* cc = getenv("CC");
+    if (!cc || !*cc) {
+        cc = "cc";
+    }
+    // Points-to analysis over thousands of h[]/l[] accesses per function
+    // took most of the build (about 3 ms per gate); without it the build
+    // is 8-10x faster and the code runs no slower, restrict already tells
+    // the compiler that the two rails do not overlap.
+    const char* cflags = "-O1 -fno-tree-pta -shared -fPIC";
+
+    // the key covers the code and how it is compiled
+    unsigned long long key = hash_text(source, source_size);
+    key ^= hash_text(cc, strlen(cc)) * 31;
+    key ^= hash_text(cflags, strlen(cflags)) * 37;
+
+    char dir[1024];
+    cache_dir(dir, sizeof(dir));
+    char* object = (char*)malloc(strlen(dir) + 64);
+    if (!object) {
+        exit(1);
+    }
+    sprintf(object, "%s/circuit-%016llx.so", dir, key);
+
+    *cached = (access(object, R_OK) == 0);
+    if (*cached) {
+        free(source);
+        return object;
+    }
+
+    // build under temporary names, then rename so a concurrent run never
+    // loads a half-written object
+    char* c_file = (char*)malloc(strlen(object) + 32);
+    char* tmp_object = (char*)malloc(strlen(object) + 32);
+    if (!c_file || !tmp_object) {
+        exit(1);
+    }
+    sprintf(c_file, "%s.%d.c", object, (int)getpid());
+    sprintf(tmp_object, "%s.%d.tmp", object, (int)getpid());
+
+    FILE* fp = fopen(c_file, "w");
+    int ok = fp && fwrite(source, 1, source_size, fp) == source_size;
+    if (fp && fclose(fp) != 0) {
+        ok = 0;
+    }
+    free(source);
+
+    if (ok) {
+        ok = run_compiler(cc, cflags, tmp_object, c_file) && rename(tmp_object, object) == 0;
+    }
+    unlink(c_file);
+    unlink(tmp_object);
+    free(c_file);
+    free(tmp_object);
+
+    if (!ok) {
+        free(object);
+        return NULL;
+    }
+    return object;
+}
+
+// copies the printed signals back into sim->state for print_state
+static void sync_printed_state(Simulator* sim, const unsigned char* h, const unsigned char* l) {
+    const int* lists[3] = { sim->input_indices, sim->output_indices, sim->dff_indices };
+    int counts[3] = { sim->input_count, sim->output_count, sim->dff_count };
+    for (int k = 0; k < 3; k++) {
+        for (int i = 0; i < counts[k]; i++) {
+            int id = lists[k][i];
+            sim_set_state(sim, id, h[id] ? VALUE_1 : l[id] ? VALUE_0 : VALUE_X);
+        }
+    }
+}
+
+// Same cycle loop and output as simulate(). Returns -1 without reading
+// any input if the circuit cannot be compiled or loaded.
+int simulate_compiled(Simulator* sim, SimIO* io) {
+    int* order = (int*)malloc((sim->gate_count + 1) * sizeof(int));
+    if (!order) {
+        exit(1);
+    }
+    int order_count = level_order(sim, order);
+
+    struct timespec build_start, build_end;
+    clock_gettime(CLOCK_MONOTONIC, &build_start);
+    int cached = 0;
+    char* object = build_object(sim, order, order_count, &cached);
+    free(order);
+    if (!object) {
+        fprintf(stderr, "Could not compile the circuit\n");
+        return -1;
+    }
+
+    void* handle = dlopen(object, RTLD_NOW | RTLD_LOCAL);
+    compiled_eval_fn eval = handle ? (compiled_eval_fn)dlsym(handle, "circuit_eval") : NULL;
+    if (!eval) {
+        fprintf(stderr, "Could not load %s: %s\n", object, dlerror());
+        if (handle) {
+            dlclose(handle);
+        }
+        free(object);
+        return -1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &build_end);
+    if (!io->quiet) {
+        printf("%s %s (%.3f s)\n", cached ? "Loaded cached" : "Compiled", object,
+               (build_end.tv_sec - build_start.tv_sec) + (build_end.tv_nsec - build_start.tv_nsec) / 1e9);
+    }
+
+    unsigned char* h = (unsigned char*)calloc(sim->gate_count + 1, 1);
+    unsigned char* l = (unsigned char*)calloc(sim->gate_count + 1, 1);
+    unsigned char* next_h = (unsigned char*)calloc(sim->dff_count + 1, 1);
+    unsigned char* next_l = (unsigned char*)calloc(sim->dff_count + 1, 1);
+    if (!h || !l || !next_h || !next_l) {
+        exit(1);
+    }
+
+    const uint8_t* inputs;
+    int cycle = 0;
+
+    clock_t start_time = clock();
+
+    while (1) {
+        if (!io->no_states) {
+            sync_printed_state(sim, h, l);
+        }
+        sim_io_state(io, sim, cycle);
+
+        sim_io_prompt(io);
+        int input_count = sim_io_next(io, &inputs);
+        if (input_count < 0) {
+            break;
+        }
+
+        for (int i = 0; i < input_count; i++) {
+            int indx = sim->input_indices[i];
+            h[indx] = (inputs[i] == VALUE_1);
+            l[indx] = (inputs[i] == VALUE_0);
+        }
+
+        for (int i = 0; i < sim->dff_count; i++) {
+            int indx = sim->dff_indices[i];
+            h[indx] = next_h[i];
+            l[indx] = next_l[i];
+        }
+
+        eval(h, l);
+
+        for (int i = 0; i < sim->dff_count; i++) {
+            int dff = sim->dff_indices[i];
+            if (sim_fanin_count(sim, dff) > 0) {
+                next_h[i] = h[sim_fanins(sim, dff)[0]];
+                next_l[i] = l[sim_fanins(sim, dff)[0]];
+            }
+        }
+
+        cycle++;
+    }
+
+    clock_t end_time = clock();
+    double cpu_time = ((double)(end_time - start_time)) / CLOCKS_PER_SEC;
+
+    if (sim_io_report(io, cycle, cpu_time)) {
+        printf("Method: Compiled Code\n");
+    }
+
+    free(h);
+    free(l);
+    free(next_h);
+    free(next_l);
+    dlclose(handle);
+    free(object);
+    return 0;
+}
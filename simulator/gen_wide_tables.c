@@ -0,0 +1,71 @@
+#include <stdio.h>
+
+/*
+ * Writes wide_tables.h: 3-valued AND, OR and XOR tables for 1 to
+ * WIDE_TABLE_INPUTS inputs. The entry for inputs v0..vk-1 (0, 1 or 2 = X)
+ * is at index ((v0 * 3 + v1) * 3 + ...) + vk-1, so a k-input gate
+ * evaluates with one load. NAND, NOR and XNOR use these and invert.
+ */
+
+#define WIDE_TABLE_INPUTS 5
+
+static const char* op_names[3] = { "and", "or", "xor" };
+
+// same rules as evaluate_input_scan: a controlling value wins over X
+static int eval_op(int op, const int* v, int k) {
+    int has_x = 0, ones = 0, zeros = 0;
+    for (int i = 0; i < k; i++) {
+        if (v[i] == 2) {
+            has_x = 1;
+        } else if (v[i] == 1) {
+            ones++;
+        } else {
+            zeros++;
+        }
+    }
+    switch (op) {
+        case 0:
+            return zeros ? 0 : has_x ? 2 : 1;
+        case 1:
+            return ones ? 1 : has_x ? 2 : 0;
+        default:
+            return has_x ? 2 : (ones & 1);
+    }
+}
+
+int main(void) {
+    printf("/* generated by gen_wide_tables, do not edit */\n\n");
+    printf("#define WIDE_TABLE_INPUTS %d\n\n", WIDE_TABLE_INPUTS);
+
+    for (int op = 0; op < 3; op++) {
+        int size = 1;
+        for (int k = 1; k <= WIDE_TABLE_INPUTS; k++) {
+            size *= 3;
+            printf("static const uint8_t wide_%s_%d[%d] = {", op_names[op], k, size);
+            for (int index = 0; index < size; index++) {
+                // digits of index, most significant first
+                int v[WIDE_TABLE_INPUTS];
+                int rest = index;
+                for (int i = k - 1; i >= 0; i--) {
+                    v[i] = rest % 3;
+                    rest /= 3;
+                }
+                printf("%s%d", index == 0 ? "\n    " : index % 27 ? ", " : ",\n    ",
+                       eval_op(op, v, k));
+            }
+            printf("\n};\n\n");
+        }
+    }
+
+    printf("// wide_tables[op][k], op 0 = AND, 1 = OR, 2 = XOR\n");
+    printf("static const uint8_t* const wide_tables[3][WIDE_TABLE_INPUTS + 1] = {\n");
+    for (int op = 0; op < 3; op++) {
+        printf("    { NULL");
+        for (int k = 1; k <= WIDE_TABLE_INPUTS; k++) {
+            printf(", wide_%s_%d", op_names[op], k);
+        }
+        printf(" },\n");
+    }
+    printf("};\n");
+    return 0;
+}
@@ -0,0 +1,783 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <unistd.h>
+#include "simulator.h"
+
+/*
+ * Multi-threaded event-driven passes. The serial code fills the level lists
+ * with the fanouts of changed inputs and DFFs as usual; a pass moves those
+ * gates into its own queues and evaluates them on a pool of worker threads.
+ *
+ * Gates on one level never read each other, so all that has to be ordered
+ * is the levels. Scheduling takes no lock and shares no counter: a fanout
+ * is claimed by an atomic test-and-set of its sched entry (from -1), so it
+ * is queued once however many of its fanins change, and the claiming worker
+ * appends it to its own buffer for the fanout's level. A level's gates are
+ * all workers' buffers for it; once nothing can be added to the level,
+ * workers take chunks from the buffers in turn, starting with their own,
+ * so the buffers are merged without copying them.
+ *
+ * Level-synchronous (PARALLEL_LEVELS): workers meet at a barrier before
+ * every non-empty level.
+ *
+ * Work stealing (PARALLEL_STEAL): pending[level] counts queued gates not yet
+ * evaluated. A worker publishes the gates a chunk queued before it retires
+ * the chunk from its own level, so when a level drops to zero nothing below
+ * the next non-empty level can get work again, and the worker that emptied
+ * it moves the frontier on. No barrier is needed between levels.
+ *
+ * Partitioned (PARALLEL_PARTITIONED): the circuit is cut into one part per
+ * worker (partition.c). A part keeps its gates, and copies of the gates
+ * they read from other parts, in a compact local view with its own state
+ * and level queues, so a worker's working set is its part only. The levels
+ * are grouped into bands such that no cut edge starts and ends inside one
+ * band. Inside a band a worker runs its part alone and records the cut
+ * values that change; at the band's end the workers meet at a barrier and
+ * each applies the values addressed to it, scheduling the local readers,
+ * which are all in later bands. The outboxes alternate between two sets by
+ * band, so one barrier per band is enough. Inputs and DFFs are refreshed
+ * from the global state at the start of a pass and are never exchanged.
+ */
+
+// gates taken from a buffer at a time
+#define PARALLEL_CHUNK 32
+
+struct ParallelWorker {
+    ParallelSim* ps;
+    int id;
+    int* added;             // per level, queued by the current chunk
+    int* touched;           // levels with added[level] != 0
+    int touched_count;
+};
+
+int parallel_default_threads(void) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n < 1) {
+        return 1;
+    }
+    return n > PARALLEL_MAX_THREADS ? PARALLEL_MAX_THREADS : (int)n;
+}
+
+// test-and-set of a gate's scheduled flag; 0 if it is already queued
+static inline int claim_gate(Simulator* sim, int gate_id) {
+    // most fanouts of a busy gate are queued already; skip the locked op
+    if (__atomic_load_n(&sim->sched[gate_id], __ATOMIC_RELAXED) != -1) {
+        return 0;
+    }
+    int expected = -1;
+    return __atomic_compare_exchange_n(&sim->sched[gate_id], &expected, sim->dummy_gate_id, 0,
+                                       __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
+// Other workers set signals while this one reads fanins, so every state
+// read in the parallel passes goes through sim_get_state_shared.
+static inline LogicValue evaluate_gate(const ParallelSim* ps, const Simulator* sim, int gate_id) {
+    return ps->use_lookup_table ? evaluate_lookup_table_shared(sim, gate_id)
+                                : evaluate_input_scan_shared(sim, gate_id);
+}
+
+static inline LevelQueue* level_queue(ParallelSim* ps, int worker, int level) {
+    return &ps->local[worker * (ps->sim->max_level + 1) + level];
+}
+
+static void push_local(LevelQueue* q, int gate_id) {
+    if (q->count == q->capacity) {
+        q->capacity = q->capacity ? q->capacity * 2 : 64;
+        q->ids = (int*)realloc(q->ids, q->capacity * sizeof(int));
+        if (!q->ids) {
+            exit(1);
+        }
+    }
+    q->ids[q->count++] = gate_id;
+}
+
+// Evaluates one gate and queues its fanouts if it changed. Returns the
+// fanout events raised.
+static inline long process_gate(ParallelWorker* w, int gate_id) {
+    ParallelSim* ps = w->ps;
+    Simulator* sim = ps->sim;
+    LogicValue new_value = evaluate_gate(ps, sim, gate_id);
+    LogicValue old_value = sim_get_state_shared(sim, gate_id);
+    long events = 0;
+
+    if (new_value != old_value) {
+        sim_set_state_shared(sim, gate_id, old_value, new_value);
+        int end = sim->fanout_start[gate_id + 1];
+        for (int i = sim->fanout_start[gate_id]; i < end; i++) {
+            int fanout_id = sim->fanouts[i];
+            if ((sim->flags[fanout_id] & SIM_DFF) || sim->level[fanout_id] < 0 ||
+                !claim_gate(sim, fanout_id)) {
+                continue;
+            }
+            int level = sim->level[fanout_id];
+            push_local(level_queue(ps, w->id, level), fanout_id);
+            if (w->added[level]++ == 0) {
+                w->touched[w->touched_count++] = level;
+            }
+        }
+        events = end - sim->fanout_start[gate_id];
+    }
+
+    // nothing below this level is left to schedule it again
+    sim->sched[gate_id] = -1;
+    return events;
+}
+
+// Makes the gates queued since the last call visible to the other workers:
+// marks their levels non-empty and, when stealing, adds them to pending.
+static void publish_added(ParallelWorker* w) {
+    ParallelSim* ps = w->ps;
+    for (int i = 0; i < w->touched_count; i++) {
+        int level = w->touched[i];
+        if (ps->mode == PARALLEL_STEAL) {
+            __atomic_fetch_add(&ps->pending[level], w->added[level], __ATOMIC_SEQ_CST);
+        } else if (!__atomic_load_n(&ps->level_active[level], __ATOMIC_RELAXED)) {
+            __atomic_store_n(&ps->level_active[level], 1, __ATOMIC_RELAXED);
+        }
+        w->added[level] = 0;
+    }
+    w->touched_count = 0;
+}
+
+// takes a chunk of q; returns how many gates, from *begin
+static inline int take_chunk(LevelQueue* q, int* begin) {
+    if (__atomic_load_n(&q->next, __ATOMIC_RELAXED) >= q->count) {
+        return 0;
+    }
+    *begin = __atomic_fetch_add(&q->next, PARALLEL_CHUNK, __ATOMIC_RELAXED);
+    if (*begin >= q->count) {
+        return 0;
+    }
+    return q->count - *begin < PARALLEL_CHUNK ? q->count - *begin : PARALLEL_CHUNK;
+}
+
+// Takes a chunk of level from any worker's buffer, own first. Returns how
+// many gates, NULL *queue if there are none left.
+static inline int take_level_chunk(ParallelWorker* w, int level, LevelQueue** queue, int* begin) {
+    ParallelSim* ps = w->ps;
+    for (int k = 0; k < ps->thread_count; k++) {
+        LevelQueue* q = level_queue(ps, (w->id + k) % ps->thread_count, level);
+        int n = take_chunk(q, begin);
+        if (n > 0) {
+            *queue = q;
+            return n;
+        }
+    }
+    *queue = NULL;
+    return 0;
+}
+
+static long run_levels(ParallelWorker* w) {
+    ParallelSim* ps = w->ps;
+    Simulator* sim = ps->sim;
+    long events = 0;
+    for (int level = 0; level <= sim->max_level; level++) {
+        // final once every lower level is done, so all workers skip alike
+        if (!__atomic_load_n(&ps->level_active[level], __ATOMIC_RELAXED)) {
+            continue;
+        }
+        LevelQueue* q;
+        int begin;
+        int n;
+        while ((n = take_level_chunk(w, level, &q, &begin)) > 0) {
+            for (int i = begin; i < begin + n; i++) {
+                events += process_gate(w, q->ids[i]);
+            }
+        }
+        publish_added(w);
+        pthread_barrier_wait(&ps->level_barrier);
+    }
+    return events;
+}
+
+static long run_stealing(ParallelWorker* w) {
+    ParallelSim* ps = w->ps;
+    int levels = ps->sim->max_level + 1;
+    long events = 0;
+
+    for (;;) {
+        int level = __atomic_load_n(&ps->frontier, __ATOMIC_SEQ_CST);
+        if (level >= levels) {
+            break;
+        }
+
+        LevelQueue* q;
+        int begin;
+        int n = take_level_chunk(w, level, &q, &begin);
+        if (n == 0) {
+            // the rest of this level is in flight on other workers
+            sched_yield();
+            continue;
+        }
+
+        for (int i = begin; i < begin + n; i++) {
+            events += process_gate(w, q->ids[i]);
+        }
+        publish_added(w);
+
+        if (__atomic_sub_fetch(&ps->pending[level], n, __ATOMIC_SEQ_CST) == 0) {
+            int next = level + 1;
+            while (next < levels && __atomic_load_n(&ps->pending[next], __ATOMIC_SEQ_CST) == 0) {
+                next++;
+            }
+            __atomic_store_n(&ps->frontier, next, __ATOMIC_SEQ_CST);
+        }
+    }
+    return events;
+}
+
+// ---- partitioned ----
+
+static inline int evaluated_gate(const Simulator* sim, int gate_id) {
+    return !(sim->flags[gate_id] & (SIM_INPUT | SIM_DFF)) && sim->level[gate_id] >= 0 &&
+           sim_fanin_count(sim, gate_id) > 0;
+}
+
+static void push_boundary(BoundaryBuffer* b, int slot, int value) {
+    if (b->count == b->capacity) {
+        b->capacity = b->capacity ? b->capacity * 2 : 64;
+        b->items = (BoundaryValue*)realloc(b->items, b->capacity * sizeof(BoundaryValue));
+        if (!b->items) {
+            exit(1);
+        }
+    }
+    b->items[b->count].slot = slot;
+    b->items[b->count].value = value;
+    b->count++;
+}
+
+static void* checked_calloc(size_t count, size_t size) {
+    void* p = calloc(count ? count : 1, size);
+    if (!p) {
+        exit(1);
+    }
+    return p;
+}
+
+// Builds part p's local view from its own gates (owned, in level order),
+// using slot_of (per gate, -1 on entry and on return) to number copies.
+// The view starts from the current state; afterwards only inputs and DFFs
+// may change outside the passes.
+static void build_partition(ParallelSim* ps, int p, const int* owned, int owned_count,
+                            int* slot_of) {
+    Simulator* sim = ps->sim;
+    Partition* P = &ps->parts[p];
+    int levels = sim->max_level + 1;
+
+    // local ids: own gates, then a copy of every other gate they read
+    int local_count = owned_count;
+    for (int i = 0; i < owned_count; i++) {
+        slot_of[owned[i]] = i;
+    }
+    for (int i = 0; i < owned_count; i++) {
+        int g = owned[i];
+        if (!evaluated_gate(sim, g)) {
+            continue;
+        }
+        const int* fanins = sim_fanins(sim, g);
+        for (int f = 0; f < sim_fanin_count(sim, g); f++) {
+            if (slot_of[fanins[f]] == -1) {
+                slot_of[fanins[f]] = local_count++;
+            }
+        }
+    }
+
+    P->owned_count = owned_count;
+    P->local_count = local_count;
+    P->global_id = (int*)checked_calloc(local_count, sizeof(int));
+    for (int i = 0; i < owned_count; i++) {
+        P->global_id[i] = owned[i];
+        int g = owned[i];
+        if (!evaluated_gate(sim, g)) {
+            continue;
+        }
+        const int* fanins = sim_fanins(sim, g);
+        for (int f = 0; f < sim_fanin_count(sim, g); f++) {
+            P->global_id[slot_of[fanins[f]]] = fanins[f];
+        }
+    }
+
+    Simulator* view = &P->view;
+    memset(view, 0, sizeof(*view));
+    view->gate_count = local_count;
+    view->max_level = sim->max_level;
+    view->state = (SimStateWord*)checked_calloc(SIM_STATE_WORDS(local_count + 1), sizeof(SimStateWord));
+    view->type = (uint8_t*)checked_calloc(local_count, 1);
+    view->level = (int*)checked_calloc(local_count, sizeof(int));
+    view->fanin_start = (int*)checked_calloc(local_count + 1, sizeof(int));
+
+    int edges = 0;
+    for (int i = 0; i < owned_count; i++) {
+        if (evaluated_gate(sim, owned[i])) {
+            edges += sim_fanin_count(sim, owned[i]);
+        }
+    }
+    view->fanins = (int*)checked_calloc(edges, sizeof(int));
+
+    int e = 0;
+    for (int i = 0; i < local_count; i++) {
+        int g = P->global_id[i];
+        view->type[i] = sim->type[g];
+        view->level[i] = sim->level[g];
+        view->fanin_start[i] = e;
+        if (i < owned_count && evaluated_gate(sim, g)) {
+            const int* fanins = sim_fanins(sim, g);
+            for (int f = 0; f < sim_fanin_count(sim, g); f++) {
+                view->fanins[e++] = slot_of[fanins[f]];
+            }
+            P->load += 1 + sim_fanin_count(sim, g);
+        } else if (i < owned_count) {
+            P->load++;
+        }
+        sim_set_state(view, i, sim_get_state(sim, g));
+    }
+    view->fanin_start[local_count] = e;
+
+    // local readers, the reverse of the local fanins
+    P->fanout_start = (int*)checked_calloc(local_count + 1, sizeof(int));
+    P->fanouts = (int*)checked_calloc(edges, sizeof(int));
+    for (int k = 0; k < edges; k++) {
+        P->fanout_start[view->fanins[k] + 1]++;
+    }
+    for (int i = 0; i < local_count; i++) {
+        P->fanout_start[i + 1] += P->fanout_start[i];
+    }
+    int* fill = (int*)checked_calloc(local_count, sizeof(int));
+    memcpy(fill, P->fanout_start, local_count * sizeof(int));
+    for (int i = 0; i < local_count; i++) {
+        for (int k = view->fanin_start[i]; k < view->fanin_start[i + 1]; k++) {
+            P->fanouts[fill[view->fanins[k]]++] = i;
+        }
+    }
+    free(fill);
+
+    P->sources = (int*)checked_calloc(local_count, sizeof(int));
+    for (int i = 0; i < local_count; i++) {
+        if (sim->flags[P->global_id[i]] & (SIM_INPUT | SIM_DFF)) {
+            P->sources[P->source_count++] = i;
+        }
+    }
+
+    // room in the queue for every own gate of a level
+    P->level_start = (int*)checked_calloc(levels + 1, sizeof(int));
+    for (int i = 0; i < owned_count; i++) {
+        if (evaluated_gate(sim, owned[i])) {
+            P->level_start[sim->level[owned[i]] + 1]++;
+        }
+    }
+    for (int level = 0; level < levels; level++) {
+        P->level_start[level + 1] += P->level_start[level];
+    }
+    P->queue = (int*)checked_calloc(owned_count, sizeof(int));
+    P->queue_count = (int*)checked_calloc(levels, sizeof(int));
+    P->queued = (uint8_t*)checked_calloc(local_count, 1);
+    P->outbox = (BoundaryBuffer*)checked_calloc(2 * ps->thread_count, sizeof(BoundaryBuffer));
+
+    for (int i = 0; i < local_count; i++) {
+        slot_of[P->global_id[i]] = -1;
+    }
+}
+
+static void build_partitions(ParallelSim* ps) {
+    Simulator* sim = ps->sim;
+    int n = sim->gate_count;
+    int k = ps->thread_count;
+    int levels = sim->max_level + 1;
+
+    ps->part = (int*)checked_calloc(n, sizeof(int));
+    ps->local_id = (int*)checked_calloc(n, sizeof(int));
+    ps->parts = (Partition*)checked_calloc(k, sizeof(Partition));
+    ps->cut_edges = partition_circuit(sim, k, ps->part);
+
+    // gates by part, in level order within a part (no level last)
+    int* bucket = (int*)checked_calloc(levels + 2, sizeof(int));
+    int* by_level = (int*)checked_calloc(n, sizeof(int));
+    for (int i = 0; i < n; i++) {
+        bucket[(sim->level[i] >= 0 ? sim->level[i] : levels) + 1]++;
+    }
+    for (int b = 0; b <= levels; b++) {
+        bucket[b + 1] += bucket[b];
+    }
+    for (int i = 0; i < n; i++) {
+        by_level[bucket[sim->level[i] >= 0 ? sim->level[i] : levels]++] = i;
+    }
+    int* part_start = (int*)checked_calloc(k + 1, sizeof(int));
+    int* owned = (int*)checked_calloc(n, sizeof(int));
+    for (int i = 0; i < n; i++) {
+        part_start[ps->part[i] + 1]++;
+    }
+    for (int p = 0; p < k; p++) {
+        part_start[p + 1] += part_start[p];
+    }
+    int* part_fill = (int*)checked_calloc(k, sizeof(int));
+    memcpy(part_fill, part_start, k * sizeof(int));
+    for (int i = 0; i < n; i++) {
+        int g = by_level[i];
+        ps->local_id[g] = part_fill[ps->part[g]] - part_start[ps->part[g]];
+        owned[part_fill[ps->part[g]]++] = g;
+    }
+    free(part_fill);
+
+    int* slot_of = by_level;
+    for (int i = 0; i < n; i++) {
+        slot_of[i] = -1;
+    }
+    for (int p = 0; p < k; p++) {
+        build_partition(ps, p, owned + part_start[p], part_start[p + 1] - part_start[p], slot_of);
+    }
+
+    // which copies to update when a gate changes; inputs and DFFs are
+    // refreshed instead
+    ps->remote_start = (int*)checked_calloc(n + 1, sizeof(int));
+    for (int p = 0; p < k; p++) {
+        Partition* P = &ps->parts[p];
+        for (int i = P->owned_count; i < P->local_count; i++) {
+            int g = P->global_id[i];
+            if (!(sim->flags[g] & (SIM_INPUT | SIM_DFF))) {
+                ps->remote_start[g + 1]++;
+            }
+        }
+    }
+    for (int i = 0; i < n; i++) {
+        ps->remote_start[i + 1] += ps->remote_start[i];
+    }
+    ps->boundary_values = ps->remote_start[n];
+    ps->remote_part = (int*)checked_calloc(ps->boundary_values, sizeof(int));
+    ps->remote_slot = (int*)checked_calloc(ps->boundary_values, sizeof(int));
+    int* fill = (int*)checked_calloc(n, sizeof(int));
+    memcpy(fill, ps->remote_start, n * sizeof(int));
+    for (int p = 0; p < k; p++) {
+        Partition* P = &ps->parts[p];
+        for (int i = P->owned_count; i < P->local_count; i++) {
+            int g = P->global_id[i];
+            if (!(sim->flags[g] & (SIM_INPUT | SIM_DFF))) {
+                ps->remote_part[fill[g]] = p;
+                ps->remote_slot[fill[g]++] = i;
+            }
+        }
+    }
+    free(fill);
+
+    // a new band starts at a level fed by an exchanged value from the
+    // current band
+    int* max_source = bucket;
+    for (int level = 0; level < levels; level++) {
+        max_source[level] = -1;
+    }
+    for (int v = 0; v < n; v++) {
+        if (!evaluated_gate(sim, v)) {
+            continue;
+        }
+        const int* fanins = sim_fanins(sim, v);
+        for (int f = 0; f < sim_fanin_count(sim, v); f++) {
+            int u = fanins[f];
+            if (ps->part[u] != ps->part[v] && !(sim->flags[u] & (SIM_INPUT | SIM_DFF)) &&
+                sim->level[u] > max_source[sim->level[v]]) {
+                max_source[sim->level[v]] = sim->level[u];
+            }
+        }
+    }
+    ps->band_last = (int*)checked_calloc(levels, sizeof(int));
+    int band_first = 0;
+    for (int level = 1; level < levels; level++) {
+        if (max_source[level] >= band_first) {
+            ps->band_last[ps->band_count++] = level - 1;
+            band_first = level;
+        }
+    }
+    ps->band_last[ps->band_count++] = levels - 1;
+
+    free(owned);
+    free(part_start);
+    free(by_level);
+    free(bucket);
+}
+
+static inline void queue_local(Partition* P, int lid) {
+    if (!P->queued[lid]) {
+        P->queued[lid] = 1;
+        int level = P->view.level[lid];
+        P->queue[P->level_start[level] + P->queue_count[level]++] = lid;
+    }
+}
+
+static long run_partition(ParallelWorker* w) {
+    ParallelSim* ps = w->ps;
+    Simulator* sim = ps->sim;
+    Partition* P = &ps->parts[w->id];
+    Simulator* view = &P->view;
+    int k = ps->thread_count;
+    long events = 0;
+
+    for (int i = 0; i < P->source_count; i++) {
+        int lid = P->sources[i];
+        sim_set_state(view, lid, sim_get_state_shared(sim, P->global_id[lid]));
+    }
+
+    int level = 0;
+    for (int b = 0; b < ps->band_count; b++) {
+        int parity = b & 1;
+        BoundaryBuffer* out = P->outbox + parity * k;
+        for (int q = 0; q < k; q++) {
+            out[q].count = 0;
+        }
+
+        for (; level <= ps->band_last[b]; level++) {
+            const int* ids = P->queue + P->level_start[level];
+            for (int i = 0; i < P->queue_count[level]; i++) {
+                int lid = ids[i];
+                P->queued[lid] = 0;
+                LogicValue new_value = evaluate_gate(ps, view, lid);
+                LogicValue old_value = sim_get_state_shared(view, lid);
+                if (new_value == old_value) {
+                    continue;
+                }
+
+                int gid = P->global_id[lid];
+                sim_set_state(view, lid, new_value);
+                sim_set_state_shared(sim, gid, old_value, new_value);
+                events += sim_fanout_count(sim, gid);
+                for (int f = P->fanout_start[lid]; f < P->fanout_start[lid + 1]; f++) {
+                    queue_local(P, P->fanouts[f]);
+                }
+                for (int r = ps->remote_start[gid]; r < ps->remote_start[gid + 1]; r++) {
+                    push_boundary(&out[ps->remote_part[r]], ps->remote_slot[r], new_value);
+                }
+            }
+            P->queue_count[level] = 0;
+        }
+
+        pthread_barrier_wait(&ps->level_barrier);
+
+        // values the other parts changed in this band
+        for (int src = 0; src < k; src++) {
+            const BoundaryBuffer* in = &ps->parts[src].outbox[parity * k + w->id];
+            for (int m = 0; m < in->count; m++) {
+                int slot = in->items[m].slot;
+                if (sim_get_state_shared(view, slot) == (LogicValue)in->items[m].value) {
+                    continue;
+                }
+                sim_set_state(view, slot, (LogicValue)in->items[m].value);
+                for (int f = P->fanout_start[slot]; f < P->fanout_start[slot + 1]; f++) {
+                    queue_local(P, P->fanouts[f]);
+                }
+            }
+        }
+    }
+    return events;
+}
+
+void print_partition_report(const ParallelSim* ps) {
+    const Simulator* sim = ps->sim;
+    long edges = sim->fanin_start[sim->gate_count];
+    long total = 0, heaviest = 0;
+    for (int p = 0; p < ps->thread_count; p++) {
+        total += ps->parts[p].load;
+        if (ps->parts[p].load > heaviest) {
+            heaviest = ps->parts[p].load;
+        }
+    }
+    double average = (double)total / ps->thread_count;
+
+    printf("Partitions: %d, cut %ld of %ld fanin edges (%.2f%%), %ld boundary values\n",
+           ps->thread_count, ps->cut_edges, edges, edges ? 100.0 * ps->cut_edges / edges : 0.0,
+           ps->boundary_values);
+    printf("Level bands: %d over %d levels, heaviest part %.2fx average load\n",
+           ps->band_count, sim->max_level + 1, average > 0 ? heaviest / average : 0.0);
+    for (int p = 0; p < ps->thread_count; p++) {
+        const Partition* P = &ps->parts[p];
+        printf("  part %2d: %8d gates  load %9ld (%.2fx)  %7d copies\n", p, P->owned_count,
+               P->load, average > 0 ? P->load / average : 0.0, P->local_count - P->owned_count);
+    }
+}
+
+static void free_partitions(ParallelSim* ps) {
+    for (int p = 0; p < ps->thread_count; p++) {
+        Partition* P = &ps->parts[p];
+        free(P->view.state);
+        free(P->view.type);
+        free(P->view.level);
+        free(P->view.fanin_start);
+        free(P->view.fanins);
+        free(P->global_id);
+        free(P->fanout_start);
+        free(P->fanouts);
+        free(P->sources);
+        free(P->level_start);
+        free(P->queue);
+        free(P->queue_count);
+        free(P->queued);
+        for (int i = 0; i < 2 * ps->thread_count; i++) {
+            free(P->outbox[i].items);
+        }
+        free(P->outbox);
+    }
+    free(ps->parts);
+    free(ps->part);
+    free(ps->local_id);
+    free(ps->remote_start);
+    free(ps->remote_part);
+    free(ps->remote_slot);
+    free(ps->band_last);
+}
+
+static void* worker_main(void* arg) {
+    ParallelWorker* w = (ParallelWorker*)arg;
+    ParallelSim* ps = w->ps;
+
+    for (;;) {
+        pthread_barrier_wait(&ps->start);
+        if (ps->stop) {
+            break;
+        }
+        switch (ps->mode) {
+            case PARALLEL_STEAL:
+                ps->events[w->id] = run_stealing(w);
+                break;
+            case PARALLEL_PARTITIONED:
+                ps->events[w->id] = run_partition(w);
+                break;
+            default:
+                ps->events[w->id] = run_levels(w);
+                break;
+        }
+        pthread_barrier_wait(&ps->done);
+    }
+    return NULL;
+}
+
+void init_parallel_sim(ParallelSim* ps, Simulator* sim, int threads, int use_lookup_table,
+                       ParallelMode mode) {
+    int levels = sim->max_level + 1;
+
+    memset(ps, 0, sizeof(*ps));
+    ps->sim = sim;
+    ps->thread_count = (threads < 1) ? 1 : (threads > PARALLEL_MAX_THREADS) ? PARALLEL_MAX_THREADS : threads;
+    // one part per thread, and every part owns at least one gate
+    if (mode == PARALLEL_PARTITIONED && ps->thread_count > sim->gate_count) {
+        ps->thread_count = sim->gate_count > 0 ? sim->gate_count : 1;
+    }
+    ps->use_lookup_table = use_lookup_table;
+    ps->mode = mode;
+    ps->events = (long*)calloc(ps->thread_count, sizeof(long));
+    ps->local = (LevelQueue*)calloc((size_t)ps->thread_count * levels, sizeof(LevelQueue));
+    ps->level_active = (int*)calloc(levels, sizeof(int));
+    ps->pending = (int*)calloc(levels, sizeof(int));
+    ps->workers = (ParallelWorker*)calloc(ps->thread_count, sizeof(ParallelWorker));
+    ps->threads = (pthread_t*)malloc(ps->thread_count * sizeof(pthread_t));
+    if (!ps->events || !ps->local || !ps->level_active || !ps->pending || !ps->workers ||
+        !ps->threads) {
+        exit(1);
+    }
+    ps->frontier = levels;
+    if (mode == PARALLEL_PARTITIONED) {
+        build_partitions(ps);
+    }
+
+    // the workers and the calling thread meet at start and done
+    pthread_barrier_init(&ps->start, NULL, ps->thread_count + 1);
+    pthread_barrier_init(&ps->done, NULL, ps->thread_count + 1);
+    pthread_barrier_init(&ps->level_barrier, NULL, ps->thread_count);
+
+    for (int i = 0; i < ps->thread_count; i++) {
+        ParallelWorker* w = &ps->workers[i];
+        w->ps = ps;
+        w->id = i;
+        w->added = (int*)calloc(levels, sizeof(int));
+        w->touched = (int*)malloc(levels * sizeof(int));
+        if (!w->added || !w->touched) {
+            exit(1);
+        }
+        if (pthread_create(&ps->threads[i], NULL, worker_main, w) != 0) {
+            fprintf(stderr, "Could not start worker thread %d\n", i);
+            exit(1);
+        }
+    }
+}
+
+// Moves the gates on the level lists into the workers' buffers, spread
+// round robin, or into the queues of the parts that own them.
+static void seed_queues(ParallelSim* ps) {
+    Simulator* sim = ps->sim;
+    int levels = sim->max_level + 1;
+    int worker = 0;
+
+    for (int level = 0; level < levels; level++) {
+        int gaten = sim->levels[level];
+        while (gaten != sim->dummy_gate_id) {
+            int next_id = sim->sched[gaten];
+            if (ps->mode == PARALLEL_PARTITIONED) {
+                sim->sched[gaten] = -1;
+                queue_local(&ps->parts[ps->part[gaten]], ps->local_id[gaten]);
+                gaten = next_id;
+                continue;
+            }
+            // stays claimed until it is evaluated
+            sim->sched[gaten] = sim->dummy_gate_id;
+            push_local(level_queue(ps, worker, level), gaten);
+            ps->pending[level]++;
+            ps->level_active[level] = 1;
+            worker = (worker + 1) % ps->thread_count;
+            gaten = next_id;
+        }
+        sim->levels[level] = sim->dummy_gate_id;
+    }
+
+    ps->frontier = 0;
+    while (ps->frontier < levels && ps->pending[ps->frontier] == 0) {
+        ps->frontier++;
+    }
+}
+
+// Parallel counterpart of evaluate_events: same results, same return value.
+long parallel_events(ParallelSim* ps) {
+    int levels = ps->sim->max_level + 1;
+
+    seed_queues(ps);
+    pthread_barrier_wait(&ps->start);
+    pthread_barrier_wait(&ps->done);
+
+    long events = 0;
+    for (int w = 0; w < ps->thread_count; w++) {
+        events += ps->events[w];
+    }
+
+    for (int i = 0; i < ps->thread_count * levels; i++) {
+        ps->local[i].count = 0;
+        ps->local[i].next = 0;
+    }
+    // pending is back to zero on its own when stealing
+    memset(ps->pending, 0, levels * sizeof(int));
+    memset(ps->level_active, 0, levels * sizeof(int));
+    ps->frontier = levels;
+    return events;
+}
+
+void free_parallel_sim(ParallelSim* ps) {
+    ps->stop = 1;
+    pthread_barrier_wait(&ps->start);
+    for (int i = 0; i < ps->thread_count; i++) {
+        pthread_join(ps->threads[i], NULL);
+        free(ps->workers[i].added);
+        free(ps->workers[i].touched);
+    }
+    pthread_barrier_destroy(&ps->start);
+    pthread_barrier_destroy(&ps->done);
+    pthread_barrier_destroy(&ps->level_barrier);
+
+    for (int i = 0; i < ps->thread_count * (ps->sim->max_level + 1); i++) {
+        free(ps->local[i].ids);
+    }
+    if (ps->parts) {
+        free_partitions(ps);
+    }
+    free(ps->local);
+    free(ps->level_active);
+    free(ps->pending);
+    free(ps->events);
+    free(ps->workers);
+    free(ps->threads);
+    memset(ps, 0, sizeof(*ps));
+}
@@ -0,0 +1,360 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "simulator.h"
+
+/*
+ * Multilevel K-way min-cut partitioning of the gate graph, for the
+ * partitioned simulation mode (parallel_sim.c). The graph is undirected,
+ * with one vertex per gate and one edge per fanin. A vertex weighs 1 plus
+ * its fanin count, roughly the work of evaluating it. The graph is
+ * coarsened by heavy-edge matching until it is small, the coarsest graph
+ * is split along a breadth-first order, and the split is projected back
+ * one level at a time with greedy boundary refinement at each level.
+ */
+
+#define PARTITION_COARSEN_TO 64     // vertices per part before splitting
+#define PARTITION_MAX_LEVELS 40
+#define PARTITION_IMBALANCE 1.05    // heaviest part / average
+#define PARTITION_REFINE_PASSES 8
+
+typedef struct PartGraph {
+    int n;
+    int* xadj;              // n + 1 offsets into adj and adjw
+    int* adj;
+    int* adjw;
+    int* vwgt;
+} PartGraph;
+
+static uint64_t part_rng = 0x9E3779B97F4A7C15ULL;
+
+static uint32_t part_random(void) {
+    part_rng ^= part_rng << 13;
+    part_rng ^= part_rng >> 7;
+    part_rng ^= part_rng << 17;
+    return (uint32_t)(part_rng >> 32);
+}
+
+static void* part_alloc(size_t size) {
+    void* p = malloc(size ? size : 1);
+    if (!p) {
+        exit(1);
+    }
+    return p;
+}
+
+static void free_graph(PartGraph* g) {
+    free(g->xadj);
+    free(g->adj);
+    free(g->adjw);
+    free(g->vwgt);
+}
+
+static int* random_order(int n) {
+    int* order = (int*)part_alloc(n * sizeof(int));
+    for (int i = 0; i < n; i++) {
+        order[i] = i;
+    }
+    for (int i = n - 1; i > 0; i--) {
+        int j = (int)(part_random() % (uint32_t)(i + 1));
+        int t = order[i];
+        order[i] = order[j];
+        order[j] = t;
+    }
+    return order;
+}
+
+// fanins and fanouts of every gate, each edge weight 1
+static void build_gate_graph(const Simulator* sim, PartGraph* g) {
+    int n = sim->gate_count;
+    int edges = sim->fanin_start[n] + sim->fanout_start[n];
+
+    g->n = n;
+    g->xadj = (int*)part_alloc((n + 1) * sizeof(int));
+    g->adj = (int*)part_alloc(edges * sizeof(int));
+    g->adjw = (int*)part_alloc(edges * sizeof(int));
+    g->vwgt = (int*)part_alloc(n * sizeof(int));
+
+    int e = 0;
+    for (int i = 0; i < n; i++) {
+        g->xadj[i] = e;
+        g->vwgt[i] = 1 + sim_fanin_count(sim, i);
+        const int* fanins = sim_fanins(sim, i);
+        for (int k = 0; k < sim_fanin_count(sim, i); k++) {
+            if (fanins[k] != i) {
+                g->adj[e] = fanins[k];
+                g->adjw[e++] = 1;
+            }
+        }
+        for (int k = sim->fanout_start[i]; k < sim->fanout_start[i + 1]; k++) {
+            if (sim->fanouts[k] != i) {
+                g->adj[e] = sim->fanouts[k];
+                g->adjw[e++] = 1;
+            }
+        }
+    }
+    g->xadj[n] = e;
+}
+
+// Heavy-edge matching: every vertex is paired with the unmatched neighbour
+// it shares the heaviest edge with, unless the pair would outweigh
+// max_vwgt. Fills cmap and the coarse graph.
+static void coarsen(const PartGraph* g, int max_vwgt, int* cmap, PartGraph* c) {
+    int n = g->n;
+    int* match = (int*)part_alloc(n * sizeof(int));
+    for (int i = 0; i < n; i++) {
+        match[i] = -1;
+    }
+
+    int* order = random_order(n);
+    for (int k = 0; k < n; k++) {
+        int u = order[k];
+        if (match[u] != -1) {
+            continue;
+        }
+        int best = u;
+        int best_w = 0;
+        for (int e = g->xadj[u]; e < g->xadj[u + 1]; e++) {
+            int v = g->adj[e];
+            if (match[v] == -1 && v != u && g->adjw[e] > best_w &&
+                g->vwgt[u] + g->vwgt[v] <= max_vwgt) {
+                best = v;
+                best_w = g->adjw[e];
+            }
+        }
+        match[u] = best;
+        match[best] = u;
+    }
+    free(order);
+
+    int cn = 0;
+    for (int u = 0; u < n; u++) {
+        if (match[u] >= u) {
+            cmap[u] = cn;
+            cmap[match[u]] = cn;
+            cn++;
+        }
+    }
+
+    c->n = cn;
+    c->xadj = (int*)part_alloc((cn + 1) * sizeof(int));
+    c->adj = (int*)part_alloc(g->xadj[n] * sizeof(int));
+    c->adjw = (int*)part_alloc(g->xadj[n] * sizeof(int));
+    c->vwgt = (int*)part_alloc(cn * sizeof(int));
+
+    // merge the pair's edges, adding up parallel ones
+    int* pos = (int*)part_alloc(cn * sizeof(int));
+    for (int i = 0; i < cn; i++) {
+        pos[i] = -1;
+    }
+    int e = 0;
+    for (int u = 0; u < n; u++) {
+        if (match[u] < u) {
+            continue;
+        }
+        int cu = cmap[u];
+        int start = e;
+        c->xadj[cu] = e;
+        c->vwgt[cu] = g->vwgt[u] + (match[u] != u ? g->vwgt[match[u]] : 0);
+        for (int m = 0; m < 2; m++) {
+            int x = m ? match[u] : u;
+            if (m && x == u) {
+                break;
+            }
+            for (int k = g->xadj[x]; k < g->xadj[x + 1]; k++) {
+                int cv = cmap[g->adj[k]];
+                if (cv == cu) {
+                    continue;
+                }
+                if (pos[cv] == -1) {
+                    pos[cv] = e;
+                    c->adj[e] = cv;
+                    c->adjw[e++] = g->adjw[k];
+                } else {
+                    c->adjw[pos[cv]] += g->adjw[k];
+                }
+            }
+        }
+        for (int k = start; k < e; k++) {
+            pos[c->adj[k]] = -1;
+        }
+    }
+    c->xadj[cn] = e;
+
+    free(pos);
+    free(match);
+}
+
+// Splits the coarsest graph into k runs of a breadth-first order, so each
+// part starts out connected where the graph allows.
+static void initial_partition(const PartGraph* g, int k, int* part) {
+    int n = g->n;
+    long total = 0;
+    for (int i = 0; i < n; i++) {
+        total += g->vwgt[i];
+        part[i] = -1;
+    }
+
+    int* queue = (int*)part_alloc(n * sizeof(int));
+    int head = 0, tail = 0;
+    int p = 0;
+    long weight = 0;
+    for (int root = 0; root < n; root++) {
+        if (part[root] != -1) {
+            continue;
+        }
+        part[root] = p;
+        queue[tail++] = root;
+        while (head < tail) {
+            int u = queue[head++];
+            part[u] = p;
+            weight += g->vwgt[u];
+            if (p < k - 1 && weight * k >= total * (p + 1)) {
+                p++;
+            }
+            for (int e = g->xadj[u]; e < g->xadj[u + 1]; e++) {
+                int v = g->adj[e];
+                if (part[v] == -1) {
+                    part[v] = p;    // queued; the final part is set when popped
+                    queue[tail++] = v;
+                }
+            }
+        }
+    }
+    free(queue);
+}
+
+// Greedy boundary refinement: moves a vertex to the adjacent part it has
+// the most edge weight to when that cuts fewer edges (or as many, toward
+// the lighter part) and keeps parts under max_weight. A vertex of a part
+// over max_weight moves even at a loss.
+static void refine(const PartGraph* g, int k, int* part, long max_weight) {
+    long* part_weight = (long*)calloc(k, sizeof(long));
+    int* conn = (int*)calloc(k, sizeof(int));
+    int* touched = (int*)part_alloc(k * sizeof(int));
+    if (!part_weight || !conn) {
+        exit(1);
+    }
+    for (int i = 0; i < g->n; i++) {
+        part_weight[part[i]] += g->vwgt[i];
+    }
+
+    int* order = random_order(g->n);
+    for (int pass = 0; pass < PARTITION_REFINE_PASSES; pass++) {
+        int moves = 0;
+        for (int i = 0; i < g->n; i++) {
+            int u = order[i];
+            int own = part[u];
+            int touched_count = 0;
+            for (int e = g->xadj[u]; e < g->xadj[u + 1]; e++) {
+                int p = part[g->adj[e]];
+                if (conn[p] == 0) {
+                    touched[touched_count++] = p;
+                }
+                conn[p] += g->adjw[e];
+            }
+
+            int overweight = part_weight[own] > max_weight;
+            int best = own;
+            int best_gain = overweight ? -(1 << 30) : 0;
+            for (int t = 0; t < touched_count; t++) {
+                int p = touched[t];
+                if (p == own || part_weight[p] + g->vwgt[u] > max_weight) {
+                    continue;
+                }
+                int gain = conn[p] - conn[own];
+                if (gain > best_gain ||
+                    (gain == best_gain && part_weight[p] + g->vwgt[u] < part_weight[own] &&
+                     (best == own || part_weight[p] < part_weight[best]))) {
+                    best = p;
+                    best_gain = gain;
+                }
+            }
+            for (int t = 0; t < touched_count; t++) {
+                conn[touched[t]] = 0;
+            }
+
+            if (best != own) {
+                part[u] = best;
+                part_weight[own] -= g->vwgt[u];
+                part_weight[best] += g->vwgt[u];
+                moves++;
+            }
+        }
+        if (moves == 0) {
+            break;
+        }
+    }
+
+    free(order);
+    free(touched);
+    free(conn);
+    free(part_weight);
+}
+
+// Fills part (one entry per gate) with a partition into k parts and returns
+// the number of fanin edges between parts.
+long partition_circuit(const Simulator* sim, int k, int* part) {
+    int n = sim->gate_count;
+    if (k <= 1 || n <= k) {
+        for (int i = 0; i < n; i++) {
+            part[i] = (k <= 1) ? 0 : i;
+        }
+    } else {
+        PartGraph graphs[PARTITION_MAX_LEVELS + 1];
+        int* cmaps[PARTITION_MAX_LEVELS];
+        int levels = 0;
+
+        build_gate_graph(sim, &graphs[0]);
+        long total = 0;
+        for (int i = 0; i < n; i++) {
+            total += graphs[0].vwgt[i];
+        }
+        // keep any one coarse vertex well below a part's weight
+        int max_vwgt = (int)(3 * total / ((long)k * PARTITION_COARSEN_TO)) + 1;
+
+        while (levels < PARTITION_MAX_LEVELS && graphs[levels].n > k * PARTITION_COARSEN_TO) {
+            PartGraph* g = &graphs[levels];
+            cmaps[levels] = (int*)part_alloc(g->n * sizeof(int));
+            coarsen(g, max_vwgt, cmaps[levels], &graphs[levels + 1]);
+            if (graphs[levels + 1].n > g->n * 9 / 10) {
+                // matching has stalled
+                free_graph(&graphs[levels + 1]);
+                free(cmaps[levels]);
+                break;
+            }
+            levels++;
+        }
+
+        long max_weight = (long)(PARTITION_IMBALANCE * total / k) + max_vwgt;
+        int* coarse_part = (int*)part_alloc(graphs[levels].n * sizeof(int));
+        initial_partition(&graphs[levels], k, coarse_part);
+        refine(&graphs[levels], k, coarse_part, max_weight);
+
+        for (int l = levels - 1; l >= 0; l--) {
+            int* fine_part = (int*)part_alloc(graphs[l].n * sizeof(int));
+            for (int i = 0; i < graphs[l].n; i++) {
+                fine_part[i] = coarse_part[cmaps[l][i]];
+            }
+            free(coarse_part);
+            free(cmaps[l]);
+            free_graph(&graphs[l + 1]);
+            coarse_part = fine_part;
+            refine(&graphs[l], k, coarse_part,
+                   l == 0 ? (long)(PARTITION_IMBALANCE * total / k) + 1 : max_weight);
+        }
+
+        memcpy(part, coarse_part, n * sizeof(int));
+        free(coarse_part);
+        free_graph(&graphs[0]);
+    }
+
+    long cut = 0;
+    for (int i = 0; i < n; i++) {
+        const int* fanins = sim_fanins(sim, i);
+        for (int f = 0; f < sim_fanin_count(sim, i); f++) {
+            cut += part[fanins[f]] != part[i];
+        }
+    }
+    return cut;
+}
@@ -0,0 +1,99 @@
+/*
+ * One pattern-parallel step, written once for every lane width.
+ * pattern_sim.c includes this file once per kernel after defining:
+ *
+ *   KERNEL_STEP    name of the step function
+ *   KERNEL_VEC     type of one rail of one signal (uint64_t or a vector)
+ *   KERNEL_PAIR    name for the hi/lo pair of KERNEL_VEC
+ *   KERNEL_TARGET  function attributes (target ISA), may be empty
+ *
+ * The step function matches pattern_step_fn. Every operation is a plain
+ * C bitwise operator, so a vector KERNEL_VEC compiles to SIMD instructions
+ * for the target without any intrinsics.
+ */
+
+typedef struct {
+    KERNEL_VEC hi;
+    KERNEL_VEC lo;
+} KERNEL_PAIR;
+
+KERNEL_TARGET static void KERNEL_STEP(PatternSim* ps) {
+    Simulator* sim = ps->sim;
+    KERNEL_PAIR* values = (KERNEL_PAIR*)ps->values;
+    KERNEL_PAIR* next_dff = (KERNEL_PAIR*)ps->next_dff;
+    const KERNEL_VEC zero = {0};
+    const KERNEL_VEC ones = ~zero;
+
+    for (int i = 0; i < sim->dff_count; i++) {
+        values[sim->dff_indices[i]] = next_dff[i];
+    }
+
+    for (int n = 0; n < ps->order_count; n++) {
+        int id = ps->order[n];
+        const int* fanins = sim_fanins(sim, id);
+        int count = sim_fanin_count(sim, id);
+        GateType type = (GateType)sim->type[id];
+        KERNEL_PAIR r;
+        KERNEL_VEC t;
+
+        switch (type) {
+            case GATE_AND:
+            case GATE_NAND:
+                r.hi = ones;
+                r.lo = zero;
+                for (int i = 0; i < count; i++) {
+                    r.hi &= values[fanins[i]].hi;
+                    r.lo |= values[fanins[i]].lo;
+                }
+                break;
+            case GATE_OR:
+            case GATE_NOR:
+                r.hi = zero;
+                r.lo = ones;
+                for (int i = 0; i < count; i++) {
+                    r.hi |= values[fanins[i]].hi;
+                    r.lo &= values[fanins[i]].lo;
+                }
+                break;
+            case GATE_XOR:
+            case GATE_XNOR:
+                r = values[fanins[0]];
+                for (int i = 1; i < count; i++) {
+                    KERNEL_PAIR v = values[fanins[i]];
+                    t = (r.hi & v.lo) | (r.lo & v.hi);
+                    r.lo = (r.hi & v.hi) | (r.lo & v.lo);
+                    r.hi = t;
+                }
+                break;
+            case GATE_BUF:
+            case GATE_WIRE:
+            case GATE_NOT:
+                r = values[fanins[0]];
+                break;
+            default:
+                r.hi = zero;
+                r.lo = zero;
+                break;
+        }
+
+        if (type == GATE_NAND || type == GATE_NOR ||
+            type == GATE_XNOR || type == GATE_NOT) {
+            t = r.hi;
+            r.hi = r.lo;
+            r.lo = t;
+        }
+        values[id] = r;
+    }
+
+    for (int i = 0; i < sim->dff_count; i++) {
+        int dff = sim->dff_indices[i];
+        if (sim_fanin_count(sim, dff) > 0) {
+            next_dff[i] = values[sim_fanins(sim, dff)[0]];
+        }
+    }
+}
+
+#undef KERNEL_STEP
+#undef KERNEL_VEC
+#undef KERNEL_PAIR
+#undef KERNEL_TARGET
@@ -0,0 +1,250 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "simulator.h"
+
+/*
+ * Pattern-parallel simulation: 64, 256 or 512 independent copies of the
+ * circuit run side by side, one per bit. Every signal is held dual-rail,
+ * so a single AND/OR per fanin evaluates a gate for all lanes at once, X
+ * included. Gates are evaluated in level order on every step (no event
+ * scheduling), which is what makes the bitwise form pay off. The wide
+ * kernels are compiled for AVX2/AVX-512 and picked at run time, so the
+ * same binary still runs on CPUs without them.
+ */
+
+// 64 lanes: plain 64-bit words, any CPU
+#define KERNEL_STEP pattern_step_64
+#define KERNEL_VEC uint64_t
+#define KERNEL_PAIR PatternPair64
+#define KERNEL_TARGET
+#include "pattern_kernel.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PATTERN_SIMD 1
+
+typedef uint64_t PatternVec256 __attribute__((vector_size(32), may_alias));
+typedef uint64_t PatternVec512 __attribute__((vector_size(64), may_alias));
+
+// 256 lanes in one AVX2 register per rail
+#define KERNEL_STEP pattern_step_256
+#define KERNEL_VEC PatternVec256
+#define KERNEL_PAIR PatternPair256
+#define KERNEL_TARGET __attribute__((target("avx2")))
+#include "pattern_kernel.h"
+
+// 512 lanes in one AVX-512 register per rail
+#define KERNEL_STEP pattern_step_512
+#define KERNEL_VEC PatternVec512
+#define KERNEL_PAIR PatternPair512
+#define KERNEL_TARGET __attribute__((target("avx512f")))
+#include "pattern_kernel.h"
+#endif
+
+// 1 word runs anywhere, 4 needs AVX2 and 8 AVX-512F on the running CPU
+int pattern_words_supported(int words) {
+    switch (words) {
+        case 1:
+            return 1;
+#ifdef PATTERN_SIMD
+        case 4:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2");
+        case 8:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx512f");
+#endif
+        default:
+            return 0;
+    }
+}
+
+// words == 0 picks the widest kernel the CPU supports
+void init_pattern_sim(PatternSim* ps, Simulator* sim, int words) {
+    if (words == 0) {
+        words = pattern_words_supported(8) ? 8 : pattern_words_supported(4) ? 4 : 1;
+    }
+
+    ps->sim = sim;
+    ps->words = words;
+    ps->lanes = words * PATTERN_WORD_LANES;
+    switch (words) {
+#ifdef PATTERN_SIMD
+        case 8:
+            ps->step = pattern_step_512;
+            ps->kernel = "avx512";
+            break;
+        case 4:
+            ps->step = pattern_step_256;
+            ps->kernel = "avx2";
+            break;
+#endif
+        default:
+            ps->step = pattern_step_64;
+            ps->kernel = "64-bit";
+            break;
+    }
+
+    // a signal is 2 * words * 8 bytes, so 64-byte alignment of the arrays
+    // keeps every vector aligned
+    size_t signal_size = 2 * words * sizeof(uint64_t);
+    size_t values_size = ((sim->gate_count + 1) * signal_size + 63) / 64 * 64;
+    size_t dff_size = ((sim->dff_count + 1) * signal_size + 63) / 64 * 64;
+    ps->values = (uint64_t*)aligned_alloc(64, values_size);
+    ps->next_dff = (uint64_t*)aligned_alloc(64, dff_size);
+    ps->order = (int*)malloc((sim->gate_count + 1) * sizeof(int));
+    if (!ps->values || !ps->next_dff || !ps->order) {
+        exit(1);
+    }
+
+    // all X
+    memset(ps->values, 0, values_size);
+    memset(ps->next_dff, 0, dff_size);
+
+    ps->order_count = level_order(sim, ps->order);
+}
+
+void free_pattern_sim(PatternSim* ps) {
+    free(ps->values);
+    free(ps->next_dff);
+    free(ps->order);
+    ps->values = NULL;
+    ps->next_dff = NULL;
+    ps->order = NULL;
+    ps->order_count = 0;
+}
+
+// One clock on every lane: DFFs take their next state, the combinational
+// logic is swept in level order with the same controlling and X rules as
+// evaluate_input_scan, and the D inputs are latched again.
+void pattern_step(PatternSim* ps) {
+    ps->step(ps);
+}
+
+void pattern_set_input(PatternSim* ps, int input, int lane, LogicValue v) {
+    uint64_t* hi = ps->values + (size_t)ps->sim->input_indices[input] * 2 * ps->words;
+    uint64_t* lo = hi + ps->words;
+    int word = lane / PATTERN_WORD_LANES;
+    uint64_t bit = (uint64_t)1 << (lane % PATTERN_WORD_LANES);
+    hi[word] &= ~bit;
+    lo[word] &= ~bit;
+    if (v == VALUE_1) {
+        hi[word] |= bit;
+    } else if (v == VALUE_0) {
+        lo[word] |= bit;
+    }
+}
+
+LogicValue pattern_get(const PatternSim* ps, int gate_id, int lane) {
+    const uint64_t* hi = ps->values + (size_t)gate_id * 2 * ps->words;
+    const uint64_t* lo = hi + ps->words;
+    int word = lane / PATTERN_WORD_LANES;
+    int shift = lane % PATTERN_WORD_LANES;
+    if ((hi[word] >> shift) & 1) {
+        return VALUE_1;
+    }
+    if ((lo[word] >> shift) & 1) {
+        return VALUE_0;
+    }
+    return VALUE_X;
+}
+
+// appends one lane's values of the given gates to buf
+static char* format_lane(char* buf, const PatternSim* ps, const int* indices, int count, int lane) {
+    for (int i = 0; i < count; i++) {
+        *buf++ = *logic_value_str(pattern_get(ps, indices[i], lane));
+    }
+    return buf;
+}
+
+// prints one lane in the same layout as print_state
+static void print_pattern_state(FILE* out, const PatternSim* ps, int lane, int cycle, char* buf) {
+    Simulator* sim = ps->sim;
+    char* p = buf;
+    p += sprintf(p, "\n\nCycle: %d\nInputs:\n", cycle);
+    p = format_lane(p, ps, sim->input_indices, sim->input_count, lane);
+    p += sprintf(p, " \nOutputs:\n");
+    p = format_lane(p, ps, sim->output_indices, sim->output_count, lane);
+    p += sprintf(p, " \nStates:\n");
+    p = format_lane(p, ps, sim->dff_indices, sim->dff_count, lane);
+    p += sprintf(p, "\n\n\n");
+    fwrite(buf, 1, p - buf, out);
+}
+
+// copies one lane's printed signals into sim->state for sim_io_state
+static void sync_lane_state(const PatternSim* ps, int lane) {
+    Simulator* sim = ps->sim;
+    const int* lists[3] = { sim->input_indices, sim->output_indices, sim->dff_indices };
+    int counts[3] = { sim->input_count, sim->output_count, sim->dff_count };
+    for (int k = 0; k < 3; k++) {
+        for (int i = 0; i < counts[k]; i++) {
+            sim_set_state(sim, lists[k][i], pattern_get(ps, lists[k][i], lane));
+        }
+    }
+}
+
+// Reads vectors like simulate() until 'q' or end of input. Vector n goes to
+// lane n % lanes, so every lane is its own machine with its own DFF
+// state. For a combinational circuit the printed results match the
+// event-driven modes vector for vector. As there, characters missing from a
+// short vector keep the previous vector's values.
+void simulate_patterns(Simulator* sim, SimIO* io, int words) {
+    PatternSim ps;
+    init_pattern_sim(&ps, sim, words);
+
+    const uint8_t* inputs;
+    char* line = (char*)malloc(sim->input_count + sim->output_count + sim->dff_count + 128);
+    if (!line) {
+        exit(1);
+    }
+
+    int cycle = 0;
+    int done = 0;
+
+    clock_t start_time = clock();
+
+    sim_io_state(io, sim, cycle);
+    while (!done) {
+        int lanes = 0;
+        while (lanes < ps.lanes) {
+            // every lane needs the whole vector, repeated or not
+            if (sim_io_next(io, &inputs) < 0) {
+                done = 1;
+                break;
+            }
+            for (int i = 0; i < sim->input_count; i++) {
+                pattern_set_input(&ps, i, lanes, (LogicValue)inputs[i]);
+            }
+            lanes++;
+        }
+        if (lanes == 0) {
+            break;
+        }
+
+        pattern_step(&ps);
+
+        if (io->no_states) {
+            cycle += lanes;
+            continue;
+        }
+        for (int lane = 0; lane < lanes; lane++) {
+            if (io->binary_out) {
+                sync_lane_state(&ps, lane);
+                sim_io_state(io, sim, ++cycle);
+            } else {
+                print_pattern_state(io->out, &ps, lane, ++cycle, line);
+            }
+        }
+    }
+
+    clock_t end_time = clock();
+    double cpu_time = ((double)(end_time - start_time)) / CLOCKS_PER_SEC;
+
+    if (sim_io_report(io, cycle, cpu_time)) {
+        printf("Method: Pattern Parallel (%d lanes, %s)\n", ps.lanes, ps.kernel);
+    }
+
+    free(line);
+    free_pattern_sim(&ps);
+}
@@ -0,0 +1,420 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "simulator.h"
+
+/*
+ * Stimulus and response streams for the cycle loops. Interactive runs read
+ * one whitespace-separated vector at a time from stdin, like scanf("%s")
+ * but of any width, and print each state with a prompt. Batch runs take
+ * the whole stimulus at once (mapped, or read in full from a pipe) and
+ * write the states to a fully buffered response file without prompts.
+ * Text and binary stimulus both come out as one LogicValue per input, so
+ * the cycle loops never see the file format.
+ */
+
+#define SIM_IO_OUT_BUFFER (1 << 20)
+
+// four 2-bit stimulus codes to four LogicValues
+static uint8_t expand_codes[256][4];
+
+static double wall_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void* io_alloc(size_t size) {
+    void* p = malloc(size ? size : 1);
+    if (!p) {
+        exit(1);
+    }
+    return p;
+}
+
+// for pipes and anything else that cannot be mapped
+static void read_whole(SimIO* io, int fd) {
+    size_t capacity = 1 << 20;
+    io->data = (char*)io_alloc(capacity);
+    io->size = 0;
+    ssize_t n;
+    while ((n = read(fd, io->data + io->size, capacity - io->size)) > 0) {
+        io->size += n;
+        if (io->size == capacity) {
+            capacity *= 2;
+            io->data = (char*)realloc(io->data, capacity);
+            if (!io->data) {
+                exit(1);
+            }
+        }
+    }
+}
+
+static void open_stimulus(SimIO* io, const char* filename) {
+    int fd = strcmp(filename, "-") == 0 ? STDIN_FILENO : open(filename, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Cannot open stimulus file: %s\n", filename);
+        exit(1);
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            madvise(map, st.st_size, MADV_SEQUENTIAL);
+            io->data = (char*)map;
+            io->size = st.st_size;
+            io->mapped = 1;
+        }
+    }
+    if (!io->mapped) {
+        read_whole(io, fd);
+    }
+    if (fd != STDIN_FILENO) {
+        close(fd);
+    }
+}
+
+static void open_binary_stimulus(SimIO* io, const char* filename) {
+    SimVectorHeader h = { 0 };
+    if (io->size >= sizeof(h)) {
+        memcpy(&h, io->data, sizeof(h));
+    }
+    if (io->size < sizeof(h) || h.version != SIM_VECTOR_VERSION ||
+        (io->size - sizeof(h)) % SIM_VECTOR_RECORD(h.signal_count) != 0) {
+        fprintf(stderr, "Bad stimulus file: %s\n", filename);
+        exit(1);
+    }
+    io->binary_in = 1;
+    io->in_signals = (int)h.signal_count;
+    io->in_record = SIM_VECTOR_RECORD(h.signal_count);
+    io->pos = sizeof(h);
+
+    for (int b = 0; b < 256; b++) {
+        for (int k = 0; k < 4; k++) {
+            expand_codes[b][k] = (uint8_t)((b >> (2 * k)) & 3);
+        }
+    }
+}
+
+static void write_response_header(SimIO* io, const Simulator* sim) {
+    SimVectorHeader h = { 0 };
+    h.magic = SIM_RESPONSE_MAGIC;
+    h.version = SIM_VECTOR_VERSION;
+    h.input_count = sim->input_count;
+    h.output_count = sim->output_count;
+    h.dff_count = sim->dff_count;
+    h.signal_count = h.input_count + h.output_count + h.dff_count;
+    h.flags = io->rle ? SIM_VECTOR_FLAG_RLE : 0;
+    fwrite(&h, sizeof(h), 1, io->out);
+
+    io->out_record = SIM_VECTOR_RECORD(h.signal_count);
+    io->prev_record = (char*)io_alloc(io->out_record);
+}
+
+// Without a stimulus file the run is interactive on stdin and stdout. A
+// stimulus file is binary if it starts with SIM_STIMULUS_MAGIC, else text.
+// Responses go to response_file if given, else stdout; binary responses
+// need a file.
+void init_sim_io(SimIO* io, const Simulator* sim, const char* stimulus_file,
+                 const char* response_file, int options) {
+    memset(io, 0, sizeof(*io));
+    io->batch = (stimulus_file != NULL);
+    io->quiet = (options & SIM_IO_QUIET) != 0;
+    io->no_states = io->quiet && !response_file;
+    io->out = stdout;
+
+    io->input_count = sim->input_count;
+    io->values = (uint8_t*)io_alloc(sim->input_count);
+    memset(io->values, VALUE_X, sim->input_count);
+
+    if (stimulus_file) {
+        open_stimulus(io, stimulus_file);
+        uint32_t magic = 0;
+        if (io->size >= sizeof(magic)) {
+            memcpy(&magic, io->data, sizeof(magic));
+        }
+        if (magic == SIM_STIMULUS_MAGIC) {
+            open_binary_stimulus(io, stimulus_file);
+        }
+    }
+    if (response_file) {
+        io->out = fopen(response_file, "w");
+        if (!io->out) {
+            fprintf(stderr, "Cannot open response file: %s\n", response_file);
+            exit(1);
+        }
+        setvbuf(io->out, NULL, _IOFBF, SIM_IO_OUT_BUFFER);
+    }
+    if (options & SIM_IO_BINARY) {
+        if (!response_file) {
+            fprintf(stderr, "Binary responses need a response file\n");
+            exit(1);
+        }
+        io->binary_out = 1;
+        io->rle = (options & SIM_IO_RLE) != 0;
+        write_response_header(io, sim);
+    }
+}
+
+// reads one vector from stdin into io->token; 0 at end of input
+static int read_token(SimIO* io) {
+    int c;
+    do {
+        c = getchar();
+    } while (c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v');
+    if (c == EOF) {
+        return 0;
+    }
+
+    size_t len = 0;
+    while (c != EOF && c != ' ' && c != '\t' && c != '\n' && c != '\r' && c != '\f' && c != '\v') {
+        if (len + 1 >= io->token_size) {
+            io->token_size = io->token_size ? io->token_size * 2 : 256;
+            io->token = (char*)realloc(io->token, io->token_size);
+            if (!io->token) {
+                exit(1);
+            }
+        }
+        io->token[len++] = (char)c;
+        c = getchar();
+    }
+    io->token[len] = '\0';
+    return (int)len;
+}
+
+// applies the next binary record to io->values; 0 for a repeat, -1 at the end
+static int next_binary(SimIO* io) {
+    if (io->repeats_left > 0) {
+        io->repeats_left--;
+        return 0;
+    }
+    if (io->pos + io->in_record > io->size) {
+        return -1;
+    }
+    const uint8_t* record = (const uint8_t*)io->data + io->pos;
+    io->pos += io->in_record;
+
+    uint32_t repeat;
+    memcpy(&repeat, record, sizeof(repeat));
+    io->repeats_left = repeat ? repeat - 1 : 0;
+
+    const uint8_t* codes = record + sizeof(repeat);
+    int n = io->in_signals < io->input_count ? io->in_signals : io->input_count;
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        uint8_t b = codes[i >> 2];
+        if (((b & (b >> 1)) & 0x55) == 0) {
+            // no SIM_VECTOR_KEEP among the four
+            memcpy(io->values + i, expand_codes[b], 4);
+            continue;
+        }
+        for (int k = 0; k < 4; k++) {
+            if (expand_codes[b][k] != SIM_VECTOR_KEEP) {
+                io->values[i + k] = expand_codes[b][k];
+            }
+        }
+    }
+    for (; i < n; i++) {
+        uint8_t code = (codes[i >> 2] >> (2 * (i & 3))) & 3;
+        if (code != SIM_VECTOR_KEEP) {
+            io->values[i] = code;
+        }
+    }
+    return io->input_count;
+}
+
+// next whitespace-separated text vector; -1 at the end or on 'q'
+static int next_text(SimIO* io, const char** vector) {
+    int len;
+    if (io->batch) {
+        const char* data = io->data;
+        size_t pos = io->pos;
+        while (pos < io->size && (data[pos] == ' ' || (data[pos] >= '\t' && data[pos] <= '\r'))) {
+            pos++;
+        }
+        size_t begin = pos;
+        while (pos < io->size && data[pos] != ' ' && (data[pos] < '\t' || data[pos] > '\r')) {
+            pos++;
+        }
+        io->pos = pos;
+        if (pos == begin) {
+            return -1;
+        }
+        *vector = data + begin;
+        len = (int)(pos - begin);
+    } else {
+        len = read_token(io);
+        if (len == 0) {
+            return -1;
+        }
+        *vector = io->token;
+    }
+
+    if ((*vector)[0] == 'q' || (*vector)[0] == 'Q') {
+        return -1;
+    }
+    return len;
+}
+
+// Points *values at the input vector for the next cycle, one LogicValue
+// per input, and returns the input count, or 0 when the vector is a
+// repeat of the previous one so no input changes. -1 at the end of the
+// stimulus. A short text vector leaves the inputs past its end as they
+// were. *values stays valid until the next call.
+int sim_io_next(SimIO* io, const uint8_t** values) {
+    if (!io->started) {
+        io->started = 1;
+        io->start = wall_seconds();
+    }
+    *values = io->values;
+
+    if (io->binary_in) {
+        return next_binary(io);
+    }
+
+    const char* vector;
+    int len = next_text(io, &vector);
+    if (len < 0) {
+        return -1;
+    }
+    for (int i = 0; i < io->input_count && i < len; i++) {
+        io->values[i] = (vector[i] == '0') ? VALUE_0 : (vector[i] == '1') ? VALUE_1 : VALUE_X;
+    }
+    return io->input_count;
+}
+
+void sim_io_prompt(SimIO* io) {
+    if (!io->batch) {
+        printf("Inputs: \n");
+    }
+}
+
+static char* format_signals(char* p, const Simulator* sim, const int* indices, int count) {
+    for (int i = 0; i < count; i++) {
+        *p++ = *logic_value_str(sim_get_state(sim, indices[i]));
+    }
+    return p;
+}
+
+static void pack_signals(char* codes, int* k, const Simulator* sim, const int* indices, int count) {
+    for (int i = 0; i < count; i++, (*k)++) {
+        codes[*k >> 2] |= (char)(sim_get_state(sim, indices[i]) << (2 * (*k & 3)));
+    }
+}
+
+static void write_run(SimIO* io) {
+    if (io->run > 0) {
+        memcpy(io->prev_record, &io->run, sizeof(io->run));
+        fwrite(io->prev_record, 1, io->out_record, io->out);
+        io->run = 0;
+    }
+}
+
+// one binary record; with RLE it is held back while it repeats
+static void write_binary_state(SimIO* io, Simulator* sim) {
+    char* record = io->state_buf;
+    memset(record, 0, io->out_record);
+    char* codes = record + sizeof(uint32_t);
+    int k = 0;
+    pack_signals(codes, &k, sim, sim->input_indices, sim->input_count);
+    pack_signals(codes, &k, sim, sim->output_indices, sim->output_count);
+    pack_signals(codes, &k, sim, sim->dff_indices, sim->dff_count);
+
+    if (io->run > 0 && io->rle && io->run < UINT32_MAX &&
+        memcmp(codes, io->prev_record + sizeof(uint32_t), io->out_record - sizeof(uint32_t)) == 0) {
+        io->run++;
+        return;
+    }
+    write_run(io);
+    io->state_buf = io->prev_record;
+    io->prev_record = record;
+    io->run = 1;
+}
+
+// Writes the state in print_state's layout, formatted into one buffer, or
+// as a binary record, and traces the cycle.
+void sim_io_state(SimIO* io, Simulator* sim, int cycle) {
+    if (io->trace) {
+        vcd_trace_cycle(io->trace, cycle);
+    }
+    if (io->no_states) {
+        return;
+    }
+    size_t need = io->binary_out ? io->out_record :
+                  (size_t)sim->input_count + sim->output_count + sim->dff_count + 64;
+    if (need > io->state_buf_size) {
+        free(io->state_buf);
+        io->state_buf = (char*)io_alloc(need);
+        io->state_buf_size = need;
+    }
+    if (io->binary_out) {
+        write_binary_state(io, sim);
+        return;
+    }
+
+    char* p = io->state_buf;
+    p += sprintf(p, "\n\nCycle: %d\nInputs:\n", cycle);
+    p = format_signals(p, sim, sim->input_indices, sim->input_count);
+    memcpy(p, " \nOutputs:\n", 11);
+    p = format_signals(p + 11, sim, sim->output_indices, sim->output_count);
+    memcpy(p, " \nStates:\n", 10);
+    p = format_signals(p + 10, sim, sim->dff_indices, sim->dff_count);
+    memcpy(p, "\n\n\n", 3);
+    fwrite(io->state_buf, 1, p + 3 - io->state_buf, io->out);
+}
+
+// Prints the end-of-run summary to stdout. Quiet runs print only the
+// cycles per second; returns 0 for them so the caller skips its method line.
+int sim_io_report(SimIO* io, int cycles, double cpu_time) {
+    if (io->trace) {
+        vcd_trace_finish(io->trace);    // tracing counts toward the run time
+    }
+    double wall = io->started ? wall_seconds() - io->start : 0;
+    if (io->binary_out) {
+        write_run(io);
+    }
+    if (io->out != stdout) {
+        fflush(io->out);
+    }
+    if (io->quiet) {
+        printf("Cycles per second: %.0f\n", wall > 0 ? cycles / wall : 0);
+        return 0;
+    }
+    printf("\nSimulation Complete!\n");
+    printf("Total cycles: %d\n", cycles);
+    printf("CPU Time: %.6f seconds\n", cpu_time);
+    if (io->batch) {
+        printf("Cycles per second: %.0f\n", wall > 0 ? cycles / wall : 0);
+    }
+    if (io->trace) {
+        printf("Waveform: %ld changes of %d signals\n", io->trace->changes, io->trace->signal_count);
+    }
+    return 1;
+}
+
+void free_sim_io(SimIO* io) {
+    if (io->mapped) {
+        munmap(io->data, io->size);
+    } else {
+        free(io->data);
+    }
+    if (io->out && io->out != stdout) {
+        fclose(io->out);
+    }
+    free(io->values);
+    free(io->token);
+    free(io->state_buf);
+    free(io->prev_record);
+    io->data = NULL;
+    io->values = NULL;
+    io->token = NULL;
+    io->state_buf = NULL;
+    io->prev_record = NULL;
+    io->out = NULL;
+}
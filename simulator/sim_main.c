@@ -1,17 +1,92 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdarg.h>
 #include "simulator.h"
 
+static int quiet = 0;
+
+// progress messages, left out of quiet runs
+static void note(const char* fmt, ...) {
+    if (quiet) {
+        return;
+    }
+    va_list args;
+    va_start(args, fmt);
+    vprintf(fmt, args);
+    va_end(args);
+}
+
 void print_usage(const char* prog_name) {
-    printf("Usage: %s <circuit_file> [method]|n", prog_name);
+    printf("Usage: %s [-i stimulus] [-o responses [-b [-r]]] [-q] [-v waveform [-n signals]] <circuit_file> [method] [threshold | threads]\n", prog_name);
+    printf("  -i stimulus: read input vectors from a file (one per line, '-' for stdin)\n");
+    printf("               instead of prompting for them; a binary stimulus from\n");
+    printf("               sim_vectors is recognized by its header\n");
+    printf("  -o responses: write the cycle states to a file instead of stdout\n");
+    printf("  -b: write the responses in binary, 2 bits per signal (sim_vectors unpack\n");
+    printf("      prints them), -r to run-length encode repeated states\n");
+    printf("  -q: quiet, print only the cycles per second (responses are still\n");
+    printf("      written to the -o file)\n");
+    printf("  -v waveform: write a VCD of every gate's value changes (event-driven\n");
+    printf("               methods only), -n to trace only the gates whose names\n");
+    printf("               match one of a comma-separated list of patterns ('G1*,out')\n");
     printf("  circuit_file: Path to circuit description file (e.g., circuit_output.txt)\n");
-    printf("  method: 'scan' for input scanning (default), 'table' for table lookup\n");
+    printf("  method: 'scan' for input scanning (default), 'table' for table lookup,\n");
+    printf("          'pattern' for 64-512 vectors at a time (widest kernel the CPU has),\n");
+    printf("          'pattern64', 'pattern256' or 'pattern512' for a fixed width,\n");
+    printf("          'hybrid' or 'hybrid-table' to switch between event-driven and\n");
+    printf("          full-sweep cycles by activity (threshold: fanout events per gate,\n");
+    printf("          default %.2f),\n", HYBRID_DEFAULT_THRESHOLD);
+    printf("          'bytecode' to sweep every gate each cycle from levelized bytecode,\n");
+    printf("          'compiled' to build the circuit into native code (cached),\n");
+    printf("          'parallel' or 'parallel-table' to split each level's events over\n");
+    printf("          threads (default: one per core), 'steal' or 'steal-table' to\n");
+    printf("          run them on work-stealing threads, 'partition' or\n");
+    printf("          'partition-table' to give each thread a part of the circuit\n");
     printf(" %s circuit_output.txt\n", prog_name);
     printf(" %s citcuit_output.txt table\n", prog_name);
+    printf(" %s -i vectors.txt -o responses.txt circuit_output.txt bytecode\n", prog_name);
 }
 
 int main(int argc, char* argv[]) {
+    const char* stimulus_file = NULL;
+    const char* response_file = NULL;
+    int io_options = 0;
+    const char* vcd_file = NULL;
+    const char* vcd_signals = NULL;
+
+    // take out the options, leaving the positional arguments in place
+    int positional = 1;
+    for (int i = 1; i < argc; i++) {
+        if ((strcmp(argv[i], "-i") == 0 || strcmp(argv[i], "-o") == 0 ||
+             strcmp(argv[i], "-v") == 0 || strcmp(argv[i], "-n") == 0) && i + 1 < argc) {
+            if (argv[i][1] == 'i') {
+                stimulus_file = argv[++i];
+            } else if (argv[i][1] == 'o') {
+                response_file = argv[++i];
+            } else if (argv[i][1] == 'v') {
+                vcd_file = argv[++i];
+            } else {
+                vcd_signals = argv[++i];
+            }
+        } else if (strcmp(argv[i], "-q") == 0) {
+            quiet = 1;
+            io_options |= SIM_IO_QUIET;
+        } else if (strcmp(argv[i], "-b") == 0) {
+            io_options |= SIM_IO_BINARY;
+        } else if (strcmp(argv[i], "-r") == 0) {
+            io_options |= SIM_IO_RLE;
+        } else {
+            argv[positional++] = argv[i];
+        }
+    }
+    argc = positional;
+
+    if (quiet && !stimulus_file) {
+        fprintf(stderr, "-q needs a stimulus file (-i)\n");
+        return 1;
+    }
+
     if (argc < 2) {
         print_usage(argv[0]);
         return 1;
@@ -19,19 +94,63 @@ int main(int argc, char* argv[]) {
 
     const char* circuit_file = argv[1];
     int use_lookup_table = 0;
+    int use_patterns = 0;
+    int pattern_words = 0;
+    int use_hybrid = 0;
+    double hybrid_threshold = HYBRID_DEFAULT_THRESHOLD;
+    int use_bytecode = 0;
+    int use_compiled = 0;
+    int use_parallel = 0;
+    ParallelMode parallel_mode = PARALLEL_LEVELS;
+    int parallel_threads = parallel_default_threads();
 
     if (argc >= 3) {
         if (strcmp(argv[2], "table") == 0) {
             use_lookup_table = 1;
-            printf("Use ooga booga table method.\n");
+            note("Use ooga booga table method.\n");
         } else if (strcmp(argv[2], "scan") == 0) {
             use_lookup_table = 0;
-            printf("Use ooga wooga scan method.\n");
+            note("Use ooga wooga scan method.\n");
+        } else if (strncmp(argv[2], "pattern", 7) == 0) {
+            use_patterns = 1;
+            if (argv[2][7] != '\0') {
+                pattern_words = atoi(argv[2] + 7) / PATTERN_WORD_LANES;
+                if (!pattern_words_supported(pattern_words)) {
+                    fprintf(stderr, "%s is not supported on this CPU\n", argv[2]);
+                    return 1;
+                }
+            }
+            note("Using pattern-parallel method.\n");
+        } else if (strcmp(argv[2], "hybrid") == 0 || strcmp(argv[2], "hybrid-table") == 0) {
+            use_hybrid = 1;
+            use_lookup_table = (argv[2][6] != '\0');
+            if (argc >= 4) {
+                hybrid_threshold = atof(argv[3]);
+            }
+            note("Using hybrid method (threshold %.3f).\n", hybrid_threshold);
+        } else if (strcmp(argv[2], "bytecode") == 0) {
+            use_bytecode = 1;
+            note("Using levelized bytecode method.\n");
+        } else if (strcmp(argv[2], "compiled") == 0) {
+            use_compiled = 1;
+            note("Using compiled-code method.\n");
+        } else if (strncmp(argv[2], "parallel", 8) == 0 || strncmp(argv[2], "steal", 5) == 0 ||
+                   strncmp(argv[2], "partition", 9) == 0) {
+            use_parallel = 1;
+            parallel_mode = (argv[2][0] == 's') ? PARALLEL_STEAL :
+                            (strncmp(argv[2], "partition", 9) == 0) ? PARALLEL_PARTITIONED : PARALLEL_LEVELS;
+            use_lookup_table = (strstr(argv[2], "-table") != NULL);
+            if (argc >= 4) {
+                parallel_threads = atoi(argv[3]);
+            }
+            note("Using parallel method (%d threads, %s).\n", parallel_threads,
+                 parallel_mode == PARALLEL_STEAL ? "work stealing" :
+                 parallel_mode == PARALLEL_PARTITIONED ? "partitioned" : "level-synchronous");
         } else {
             printf("Error.\n");
         }
     } else {
-        printf("Using input scanning method.\n");
+        note("Using input scanning method.\n");
     }
 
     // create simulator object
@@ -44,13 +163,51 @@ int main(int argc, char* argv[]) {
     // load the circuit
     load_circuit_file(circuit_file, &sim);
 
+    SimIO io;
+    init_sim_io(&io, &sim, stimulus_file, response_file, io_options);
+
+    // the other methods keep their own values and only update the printed
+    // signals in sim->state
+    VcdTrace trace;
+    if (vcd_file) {
+        if (use_patterns || use_bytecode || use_compiled) {
+            fprintf(stderr, "Waveforms need an event-driven method\n");
+            return 1;
+        }
+        if (init_vcd_trace(&trace, &sim, vcd_file, vcd_signals) != 0) {
+            return 1;
+        }
+        io.trace = &trace;
+    }
+
     // run simulation
-    printf("\nStarting Simulation: \n");
-    printf("Enter input values as a string (for example '0110')\n");
-    printf("Enter q to quit:\n");
+    note("\nStarting Simulation: \n");
+    if (!io.batch) {
+        printf("Enter input values as a string (for example '0110')\n");
+        printf("Enter q to quit:\n");
+    }
 
-    simulate(&sim, use_lookup_table);
+    if (use_patterns) {
+        simulate_patterns(&sim, &io, pattern_words);
+    } else if (use_hybrid) {
+        simulate_hybrid(&sim, &io, use_lookup_table, hybrid_threshold);
+    } else if (use_parallel) {
+        simulate_parallel(&sim, &io, use_lookup_table, parallel_threads, parallel_mode);
+    } else if (use_bytecode) {
+        simulate_bytecode(&sim, &io);
+    } else if (use_compiled) {
+        if (simulate_compiled(&sim, &io) != 0) {
+            note("Falling back to input scanning.\n");
+            simulate(&sim, &io, 0);
+        }
+    } else {
+        simulate(&sim, &io, use_lookup_table);
+    }
 
+    if (vcd_file) {
+        free_vcd_trace(&trace);
+    }
+    free_sim_io(&io);
     free_simulator(&sim);
 
     return 0;
@@ -0,0 +1,221 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "simulator.h"
+
+/*
+ * Converts between text vectors and the binary stimulus and response
+ * files (see SimVectorHeader in simulator.h).
+ *
+ *   sim_vectors pack [-r] vectors.txt stimulus.bin
+ *   sim_vectors unpack responses.bin
+ *
+ * pack reads vectors like circuit_simulator -i does, up to the end or a
+ * 'q', and writes one record per vector, as wide as the widest vector.
+ * Positions past the end of a short vector are SIM_VECTOR_KEEP. -r merges
+ * repeated vectors into one record. unpack prints binary responses in
+ * print_state's layout, as circuit_simulator -o would have written them.
+ */
+
+#define VECTORS_OUT_BUFFER (1 << 20)
+
+static void* vec_alloc(size_t size) {
+    void* p = calloc(size ? size : 1, 1);
+    if (!p) {
+        exit(1);
+    }
+    return p;
+}
+
+static const char* map_file(const char* filename, size_t* size) {
+    int fd = open(filename, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        fprintf(stderr, "File failed: %s\n", filename);
+        exit(1);
+    }
+    *size = (size_t)st.st_size;
+    if (*size == 0) {
+        close(fd);
+        return "";
+    }
+    void* map = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "mmap failed: %s\n", filename);
+        exit(1);
+    }
+    madvise(map, *size, MADV_SEQUENTIAL);
+    return (const char*)map;
+}
+
+static FILE* create_file(const char* filename) {
+    FILE* fp = fopen(filename, "w");
+    if (!fp) {
+        fprintf(stderr, "Cannot create %s\n", filename);
+        exit(1);
+    }
+    setvbuf(fp, NULL, _IOFBF, VECTORS_OUT_BUFFER);
+    return fp;
+}
+
+static int is_space(char c) {
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+// next vector in data[*pos..size); its length, 0 at the end or on 'q'
+static size_t next_vector(const char* data, size_t size, size_t* pos, const char** vector) {
+    size_t p = *pos;
+    while (p < size && is_space(data[p])) {
+        p++;
+    }
+    size_t begin = p;
+    while (p < size && !is_space(data[p])) {
+        p++;
+    }
+    *pos = p;
+    *vector = data + begin;
+    if (p == begin || data[begin] == 'q' || data[begin] == 'Q') {
+        return 0;
+    }
+    return p - begin;
+}
+
+static int pack(const char* text_file, const char* bin_file, int rle) {
+    size_t size;
+    const char* data = map_file(text_file, &size);
+
+    const char* vector;
+    size_t len, pos = 0, width = 0;
+    while ((len = next_vector(data, size, &pos, &vector)) > 0) {
+        width = len > width ? len : width;
+    }
+
+    FILE* out = create_file(bin_file);
+    SimVectorHeader h = { 0 };
+    h.magic = SIM_STIMULUS_MAGIC;
+    h.version = SIM_VECTOR_VERSION;
+    h.signal_count = (uint32_t)width;
+    h.input_count = (uint32_t)width;
+    h.flags = rle ? SIM_VECTOR_FLAG_RLE : 0;
+    fwrite(&h, sizeof(h), 1, out);
+
+    size_t record_size = SIM_VECTOR_RECORD(width);
+    uint8_t* record = (uint8_t*)vec_alloc(record_size);
+    uint8_t* prev = (uint8_t*)vec_alloc(record_size);
+    uint32_t run = 0;
+    long vectors = 0, records = 0;
+
+    pos = 0;
+    while ((len = next_vector(data, size, &pos, &vector)) > 0) {
+        uint8_t* codes = record + sizeof(uint32_t);
+        memset(codes, 0xFF, record_size - sizeof(uint32_t));    // all SIM_VECTOR_KEEP
+        for (size_t i = 0; i < len; i++) {
+            uint8_t v = (vector[i] == '0') ? VALUE_0 : (vector[i] == '1') ? VALUE_1 : VALUE_X;
+            codes[i >> 2] &= (uint8_t)~((3 ^ v) << (2 * (i & 3)));
+        }
+        vectors++;
+
+        if (run > 0 && rle && run < UINT32_MAX &&
+            memcmp(codes, prev + sizeof(uint32_t), record_size - sizeof(uint32_t)) == 0) {
+            run++;
+            continue;
+        }
+        if (run > 0) {
+            memcpy(prev, &run, sizeof(run));
+            fwrite(prev, 1, record_size, out);
+            records++;
+        }
+        uint8_t* t = prev;
+        prev = record;
+        record = t;
+        run = 1;
+    }
+    if (run > 0) {
+        memcpy(prev, &run, sizeof(run));
+        fwrite(prev, 1, record_size, out);
+        records++;
+    }
+
+    if (fclose(out) != 0) {
+        fprintf(stderr, "Write failed: %s\n", bin_file);
+        return 1;
+    }
+    printf("%ld vectors of %zu inputs in %ld records\n", vectors, width, records);
+    free(record);
+    free(prev);
+    return 0;
+}
+
+static char* format_codes(char* p, const uint8_t* codes, int first, int count) {
+    for (int k = first; k < first + count; k++) {
+        int v = (codes[k >> 2] >> (2 * (k & 3))) & 3;
+        *p++ = (v == VALUE_0) ? '0' : (v == VALUE_1) ? '1' : '4';
+    }
+    return p;
+}
+
+static int unpack(const char* bin_file) {
+    size_t size;
+    const char* data = map_file(bin_file, &size);
+
+    SimVectorHeader h = { 0 };
+    if (size >= sizeof(h)) {
+        memcpy(&h, data, sizeof(h));
+    }
+    size_t record_size = SIM_VECTOR_RECORD(h.signal_count);
+    if (size < sizeof(h) || h.magic != SIM_RESPONSE_MAGIC || h.version != SIM_VECTOR_VERSION ||
+        (uint64_t)h.input_count + h.output_count + h.dff_count != h.signal_count ||
+        (size - sizeof(h)) % record_size != 0) {
+        fprintf(stderr, "Bad response file: %s\n", bin_file);
+        return 1;
+    }
+
+    setvbuf(stdout, NULL, _IOFBF, VECTORS_OUT_BUFFER);
+    char* buf = (char*)vec_alloc((size_t)h.signal_count + 64);
+    int cycle = 0;
+    for (size_t pos = sizeof(h); pos < size; pos += record_size) {
+        uint32_t run;
+        memcpy(&run, data + pos, sizeof(run));
+        const uint8_t* codes = (const uint8_t*)data + pos + sizeof(run);
+
+        // the record is the same for the whole run but for the cycle number
+        char* p = buf;
+        p = format_codes(p, codes, 0, h.input_count);
+        memcpy(p, " \nOutputs:\n", 11);
+        p = format_codes(p + 11, codes, h.input_count, h.output_count);
+        memcpy(p, " \nStates:\n", 10);
+        p = format_codes(p + 10, codes, h.input_count + h.output_count, h.dff_count);
+        memcpy(p, "\n\n\n", 3);
+        p += 3;
+
+        for (uint32_t r = 0; r < run; r++) {
+            printf("\n\nCycle: %d\nInputs:\n", cycle++);
+            fwrite(buf, 1, p - buf, stdout);
+        }
+    }
+    free(buf);
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc == 3 && strcmp(argv[1], "unpack") == 0) {
+        return unpack(argv[2]);
+    }
+    if (argc == 4 && strcmp(argv[1], "pack") == 0) {
+        return pack(argv[2], argv[3], 0);
+    }
+    if (argc == 5 && strcmp(argv[1], "pack") == 0 && strcmp(argv[2], "-r") == 0) {
+        return pack(argv[3], argv[4], 1);
+    }
+    printf("Usage: %s pack [-r] <vectors.txt> <stimulus.bin>\n", argv[0]);
+    printf("       %s unpack <responses.bin>\n", argv[0]);
+    printf("  pack: text vectors to a binary stimulus for circuit_simulator -i,\n");
+    printf("        -r to run-length encode repeated vectors\n");
+    printf("  unpack: print binary responses (circuit_simulator -o file -b) as text\n");
+    return 1;
+}
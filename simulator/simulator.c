@@ -2,7 +2,12 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "simulator.h"
+#include "wide_tables.h"
 
 LogicValue not_table[3];
 LogicValue and_table[3][3];
@@ -13,19 +18,77 @@ LogicValue xor_table[3][3];
 LogicValue xnor_table[3][3];
 
 void init_simulator(Simulator* sim) {
-    sim->gates = NULL;
-    sim->gate_count = 0;
-    sim->input_count = 0;
-    sim->output_count = 0;
-    sim->dff_count = 0;
-    sim->max_level = 0;
-    sim->input_indices = NULL;
-    sim->output_indices = NULL;
-    sim->dff_indices = NULL;
-    sim->levels = NULL;
+    memset(sim, 0, sizeof(*sim));
     sim->dummy_gate_id = -1;
 }
 
+// grows an int array to hold at least need elements
+static int* grow_ints(int* items, int* capacity, int need) {
+    if (need <= *capacity) {
+        return items;
+    }
+    while (*capacity < need) {
+        *capacity = *capacity ? *capacity * 2 : 64;
+    }
+    items = (int*)realloc(items, *capacity * sizeof(int));
+    if (!items) {
+        exit(1);
+    }
+    return items;
+}
+
+// allocates the per-gate run-time arrays, fills the input/output/DFF
+// index lists from the flags and appends the dummy gate and the empty
+// level schedule
+static void finish_load(Simulator* sim) {
+    int n = sim->gate_count;
+    size_t state_size = SIM_STATE_WORDS(n + 1) * sizeof(SimStateWord);
+    sim->state = (SimStateWord*)malloc(state_size);
+    sim->sched = (int*)malloc((n + 1) * sizeof(int));
+    sim->input_indices = (int*)malloc((sim->input_count + 1) * sizeof(int));
+    sim->output_indices = (int*)malloc((sim->output_count + 1) * sizeof(int));
+    sim->dff_indices = (int*)malloc((sim->dff_count + 1) * sizeof(int));
+    sim->dff_next = (uint8_t*)malloc(sim->dff_count + 1);
+    sim->levels = (int*)malloc((sim->max_level + 1) * sizeof(int));
+    if (!sim->state || !sim->sched || !sim->input_indices || !sim->output_indices ||
+        !sim->dff_indices || !sim->dff_next || !sim->levels) {
+        exit(1);
+    }
+
+    memset(sim->state, SIM_STATE_ALL_X, state_size);
+    memset(sim->dff_next, VALUE_X, sim->dff_count + 1);
+    for (int i = 0; i <= n; i++) {
+        sim->sched[i] = -1;
+    }
+
+    int input_indx = 0, output_indx = 0, dff_indx = 0;
+    for (int i = 0; i < n; i++) {
+        if ((sim->flags[i] & SIM_INPUT) && input_indx < sim->input_count) {
+            sim->input_indices[input_indx++] = i;
+        }
+        if ((sim->flags[i] & SIM_OUTPUT) && output_indx < sim->output_count) {
+            sim->output_indices[output_indx++] = i;
+        }
+        if ((sim->flags[i] & SIM_DFF) && dff_indx < sim->dff_count) {
+            sim->dff_indices[dff_indx++] = i;
+        }
+    }
+
+    sim->flags[n] = 0;
+    sim->dummy_gate_id = n;
+
+    // initialize level schedule array
+    for (int i = 0; i <= sim->max_level; i++) {
+        sim->levels[i] = sim->dummy_gate_id;
+    }
+}
+
+static uint8_t gate_flags(GateType type, int is_output) {
+    return (type == GATE_INPUT ? SIM_INPUT : 0) |
+           (type == GATE_DFF ? SIM_DFF : 0) |
+           (is_output ? SIM_OUTPUT : 0);
+}
+
 void load_circuit_file(const char* filename, Simulator* sim) {
     FILE *fp = fopen(filename, "r");
     if (!fp) {
@@ -33,77 +96,178 @@ void load_circuit_file(const char* filename, Simulator* sim) {
         exit(1);
     }
 
+    uint32_t magic = 0;
+    if (fread(&magic, sizeof(magic), 1, fp) == 1 && magic == CIRCUIT_BIN_MAGIC) {
+        fclose(fp);
+        load_circuit_binary(filename, sim);
+        return;
+    }
+    rewind(fp);
+
     fscanf(fp, "%d %d %d %d", &sim->gate_count, &sim->input_count, 
         &sim->output_count, &sim->dff_count);
-    
-    sim->gates = (SimGate*)malloc((sim->gate_count + 1) * sizeof(SimGate));
-    sim->input_indices = (int*)malloc((sim->input_count * sizeof(int)));
-    sim->output_indices = (int*)malloc((sim->output_count * sizeof(int)));
-    sim->dff_indices = (int*)malloc(sim->dff_count * sizeof(int));
 
-    int input_indx = 0, output_indx = 0, dff_indx = 0;
-    for (int i = 0 ; i < sim->gate_count; i++) {
-        SimGate* g = &sim->gates[i];
-        g->id = i;
-
-        int gate_type;
-        fscanf(fp, "%d %d %d %d", &gate_type, &g->is_output, &g->level, &g->fanin_count);
-
-        g->type = (GateType)gate_type;
-        g->is_input = (g->type == GATE_INPUT);
-        g->is_dff = (g->type == GATE_DFF);
-        g->state = VALUE_X;
-        g->next_state = VALUE_X;
-        g->sched = -1;
-
-        if (g->level > sim->max_level) {
-            sim->max_level = g->level;
-        }
+    int n = sim->gate_count;
+    sim->type = (uint8_t*)malloc(n + 1);
+    sim->flags = (uint8_t*)malloc(n + 1);
+    sim->level = (int*)malloc((n + 1) * sizeof(int));
+    sim->fanin_start = (int*)malloc((n + 1) * sizeof(int));
+    sim->fanout_start = (int*)malloc((n + 1) * sizeof(int));
+    sim->name_offsets = (uint32_t*)malloc((n + 1) * sizeof(uint32_t));
+    if (!sim->type || !sim->flags || !sim->level || !sim->fanin_start ||
+        !sim->fanout_start || !sim->name_offsets) {
+        exit(1);
+    }
 
-        g->fanins = (int*)malloc(g->fanin_count * sizeof(int));
-        for (int j = 0; j < g->fanin_count; j++) {
-            fscanf(fp, "%d", &g->fanins[j]);
-        }
+    // edge and name counts are not in the header, so these grow as they fill
+    int fanin_capacity = 0, fanout_capacity = 0;
+    int fanin_edges = 0, fanout_edges = 0;
+    size_t names_size = 0, names_capacity = 0;
 
-        fscanf(fp, "%d", &g->fanout_count);
-        g->fanouts = (int*)malloc(g->fanout_count * sizeof(int));
-        for (int j = 0; j < g->fanout_count; j++) {
-            fscanf(fp, "%d", &g->fanouts[j]);
+    for (int i = 0 ; i < n; i++) {
+        int gate_type, is_output, count;
+        fscanf(fp, "%d %d %d %d", &gate_type, &is_output, &sim->level[i], &count);
+
+        if (gate_type < 0 || gate_type >= GATE_TYPE_COUNT) {
+            fprintf(stderr, "Bad gate type %d in %s\n", gate_type, filename);
+            exit(1);
         }
+        sim->type[i] = (uint8_t)gate_type;
+        sim->flags[i] = gate_flags((GateType)gate_type, is_output);
 
-        char name[256];
-        fscanf(fp, "%s", name);
-        g->name = strdup(name);
+        if (sim->level[i] > sim->max_level) {
+            sim->max_level = sim->level[i];
+        }
 
-        if (g->is_input) {
-            sim->input_indices[input_indx++] = i;
+        sim->fanin_start[i] = fanin_edges;
+        sim->fanins = grow_ints(sim->fanins, &fanin_capacity, fanin_edges + count);
+        for (int j = 0; j < count; j++) {
+            fscanf(fp, "%d", &sim->fanins[fanin_edges++]);
         }
-        if (g->is_output) {
-            sim->output_indices[output_indx++] = i;
+
+        fscanf(fp, "%d", &count);
+        sim->fanout_start[i] = fanout_edges;
+        sim->fanouts = grow_ints(sim->fanouts, &fanout_capacity, fanout_edges + count);
+        for (int j = 0; j < count; j++) {
+            fscanf(fp, "%d", &sim->fanouts[fanout_edges++]);
         }
-        if (g->is_dff) {
-            sim->dff_indices[dff_indx++] = i;
+
+        char name[256];
+        fscanf(fp, "%255s", name);
+        size_t len = strlen(name) + 1;
+        if (names_size + len > names_capacity) {
+            names_capacity = names_capacity ? names_capacity * 2 : 4096;
+            while (names_size + len > names_capacity) {
+                names_capacity *= 2;
+            }
+            sim->names = (char*)realloc(sim->names, names_capacity);
+            if (!sim->names) {
+                exit(1);
+            }
         }
+        memcpy(sim->names + names_size, name, len);
+        sim->name_offsets[i] = (uint32_t)names_size;
+        names_size += len;
     }
+    sim->fanin_start[n] = fanin_edges;
+    sim->fanout_start[n] = fanout_edges;
 
     fclose(fp);
 
-    // create dummy gate
-    sim->dummy_gate_id = sim->gate_count;
-    SimGate* dummy = &sim->gates[sim->dummy_gate_id];
-    dummy->id = sim->dummy_gate_id;
-    dummy->name = strdup("dummy");
-    dummy->sched = -1;
-    dummy->fanin_count = 0;
-    dummy->fanout_count = 0;
-    dummy->fanins = NULL;
-    dummy->fanouts = NULL;
+    finish_load(sim);
+}
 
-    // initialize level schedule array
-    sim->levels = (SimGate**)malloc((sim->max_level +1) * sizeof(SimGate *));
-    for (int i = 0; i <= sim->max_level; i++) {
-        sim->levels[i] = dummy;
+// checks that a section of count elements lies inside the mapping
+static int section_ok(size_t size, uint64_t offset, uint64_t count, size_t elem) {
+    return offset % 4 == 0 && offset <= size && count * elem <= size - offset;
+}
+
+// Maps a file written by circuit_parser -b. The file is already laid out
+// as CSR arrays, so connectivity, types, levels and names are used straight
+// from the mapping: loading does no parsing and no per-gate allocation.
+void load_circuit_binary(const char* filename, Simulator* sim) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "File failed: %s\n", filename);
+        exit(1);
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(CircuitFileHeader)) {
+        fprintf(stderr, "Bad binary circuit file: %s\n", filename);
+        exit(1);
+    }
+
+    size_t size = (size_t)st.st_size;
+    void* map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "mmap failed: %s\n", filename);
+        exit(1);
+    }
+
+    const char* base = (const char*)map;
+    const CircuitFileHeader* h = (const CircuitFileHeader*)base;
+    uint64_t n = h->gate_count;
+    if (h->magic != CIRCUIT_BIN_MAGIC || h->version != CIRCUIT_BIN_VERSION ||
+        !section_ok(size, h->fanin_offsets, n + 1, sizeof(int32_t)) ||
+        !section_ok(size, h->fanins, h->fanin_edges, sizeof(int32_t)) ||
+        !section_ok(size, h->fanout_offsets, n + 1, sizeof(int32_t)) ||
+        !section_ok(size, h->fanouts, h->fanout_edges, sizeof(int32_t)) ||
+        !section_ok(size, h->types, n, 1) ||
+        !section_ok(size, h->flags, n, 1) ||
+        !section_ok(size, h->levels, n, sizeof(int32_t)) ||
+        !section_ok(size, h->name_offsets, n, sizeof(uint32_t)) ||
+        !section_ok(size, h->names, h->names_size, 1)) {
+        fprintf(stderr, "Bad binary circuit file: %s\n", filename);
+        exit(1);
+    }
+
+    const uint8_t* file_flags = (const uint8_t*)(base + h->flags);
+
+    sim->mapping = map;
+    sim->mapping_size = size;
+    sim->gate_count = h->gate_count;
+    sim->input_count = h->input_count;
+    sim->output_count = h->output_count;
+    sim->dff_count = h->dff_count;
+
+    // the mapping is read-only; these arrays are never written
+    sim->fanin_start = (int*)(base + h->fanin_offsets);
+    sim->fanins = (int*)(base + h->fanins);
+    sim->fanout_start = (int*)(base + h->fanout_offsets);
+    sim->fanouts = (int*)(base + h->fanouts);
+    sim->type = (uint8_t*)(base + h->types);
+    sim->level = (int*)(base + h->levels);
+    sim->name_offsets = (uint32_t*)(base + h->name_offsets);
+    sim->names = (char*)(base + h->names);
+
+    sim->flags = (uint8_t*)malloc(n + 1);
+    if (!sim->flags) {
+        exit(1);
+    }
+
+    if (sim->fanin_start[0] != 0 || sim->fanout_start[0] != 0) {
+        fprintf(stderr, "Bad binary circuit file: %s\n", filename);
+        exit(1);
     }
+    for (int i = 0; i < sim->gate_count; i++) {
+        if (sim->fanin_start[i] > sim->fanin_start[i + 1] ||
+            (uint32_t)sim->fanin_start[i + 1] > h->fanin_edges ||
+            sim->fanout_start[i] > sim->fanout_start[i + 1] ||
+            (uint32_t)sim->fanout_start[i + 1] > h->fanout_edges ||
+            sim->name_offsets[i] >= h->names_size || sim->type[i] >= GATE_TYPE_COUNT) {
+            fprintf(stderr, "Bad binary circuit file: %s\n", filename);
+            exit(1);
+        }
+
+        sim->flags[i] = gate_flags((GateType)sim->type[i], (file_flags[i] & CIRCUIT_FLAG_OUTPUT) != 0);
+        if (sim->level[i] > sim->max_level) {
+            sim->max_level = sim->level[i];
+        }
+    }
+
+    finish_load(sim);
 }
 
 void init_lookup_tables(void) {
@@ -179,71 +343,41 @@ void init_lookup_tables(void) {
     xnor_table[VALUE_X][VALUE_X] = VALUE_X;
 }
 
+// Single-threaded: pushes onto the level list through sched. The parallel
+// passes (parallel_sim.c) claim gates with an atomic test-and-set instead.
 void schedule_gate(int gate_id, Simulator* sim) {
-    SimGate* gate = &sim->gates[gate_id];
-    if (gate->sched != -1) {
+    if (sim->sched[gate_id] != -1) {
         return;
     }
 
-    int level = gate->level;
-    SimGate* curr_head = sim->levels[level];
-    gate->sched = curr_head->id;
-    sim->levels[level] = gate;
+    int level = sim->level[gate_id];
+    sim->sched[gate_id] = sim->levels[level];
+    sim->levels[level] = gate_id;
 }
 
 void schedule_fanout(int gate_id, Simulator* sim) {
-    SimGate* gate = &sim->gates[gate_id];
-    for (int i = 0; i < gate->fanout_count; i++) {
-        int fanout_id = gate->fanouts[i];
-        SimGate* fanout_gate = &sim->gates[fanout_id];
-        if (!fanout_gate->is_dff) {
+    int end = sim->fanout_start[gate_id + 1];
+    for (int i = sim->fanout_start[gate_id]; i < end; i++) {
+        int fanout_id = sim->fanouts[i];
+        if (!(sim->flags[fanout_id] & SIM_DFF)) {
             schedule_gate(fanout_id, sim);
         }
     }
 }
 
-LogicValue evaluate_input_scan(SimGate* gate, SimGate* all_gates) {
-    int cont_value, inversion;
-
-    switch (gate->type) {
-        case GATE_AND:
-            cont_value = 0;
-            inversion = 0;
-            break;
-        case GATE_OR:
-            cont_value = 1;
-            inversion = 0;
-            break;
-        case GATE_NAND:
-            cont_value = 0;
-            inversion = 1;
-            break;
-        case GATE_NOR:
-            cont_value = 1;
-            inversion = 1;
-            break;
-        case GATE_NOT:
-            if (gate->fanin_count > 0) {
-                return not_table[all_gates[gate->fanins[0]].state];
-            }
-            return VALUE_X;
-        case GATE_BUF:
-            if (gate->fanin_count > 0) {
-                return all_gates[gate->fanins[0]].state;
-            }
-            return VALUE_X;
-        case GATE_WIRE:
-            if (gate->fanin_count > 0) {
-                return all_gates[gate->fanins[0]].state;
-            }
-            return VALUE_X;
-        default:
-            return evaluate_lookup_table(gate, all_gates);
-    }
+// Fanin reads below. shared is a constant in every caller, 1 for the
+// multi-threaded passes, where other threads set signals meanwhile.
+static inline LogicValue fanin_state(const Simulator* sim, int gate_id, int shared) {
+    return shared ? sim_get_state_shared(sim, gate_id) : sim_get_state(sim, gate_id);
+}
 
+// 3-valued AND/OR with a controlling value: any fanin at cont_value decides
+// the output, otherwise X if any fanin is X
+static inline LogicValue eval_controlling(const Simulator* sim, const int* fanins, int count,
+                                          int cont_value, int inversion, int shared) {
     int has_unknown = 0;
-    for (int i = 0; i < gate->fanin_count; i++) {
-        LogicValue v = all_gates[gate->fanins[i]].state;
+    for (int i = 0; i < count; i++) {
+        LogicValue v = fanin_state(sim, fanins[i], shared);
 
         if (v == cont_value) {
             return (inversion) ? (1 - cont_value) : cont_value;
@@ -259,50 +393,232 @@ LogicValue evaluate_input_scan(SimGate* gate, SimGate* all_gates) {
     return inversion ? cont_value : (1 - cont_value);
 }
 
-LogicValue evaluate_lookup_table(SimGate* gate, SimGate* all_gates) {
-    if (gate->fanin_count == 0) {
+// op 0 = AND, 1 = OR, 2 = XOR through the generated wide tables. Up to
+// WIDE_TABLE_INPUTS fanins per load; a longer gate carries the partial
+// result into the next chunk as its first input.
+static inline LogicValue eval_wide(const Simulator* sim, const int* fanins, int count,
+                                   int op, int inverted, int shared) {
+    const uint8_t* const* tables = wide_tables[op];
+    int k = count < WIDE_TABLE_INPUTS ? count : WIDE_TABLE_INPUTS;
+    unsigned index = 0;
+    for (int i = 0; i < k; i++) {
+        index = index * 3 + fanin_state(sim, fanins[i], shared);
+    }
+    LogicValue v = (LogicValue)tables[k][index];
+    for (int i = k; i < count; i += k) {
+        k = count - i < WIDE_TABLE_INPUTS - 1 ? count - i : WIDE_TABLE_INPUTS - 1;
+        index = v;
+        for (int j = 0; j < k; j++) {
+            index = index * 3 + fanin_state(sim, fanins[i + j], shared);
+        }
+        v = (LogicValue)tables[k + 1][index];
+    }
+    return inverted ? not_table[v] : v;
+}
+
+// One gate of a known type. type and use_lookup_table are constants in
+// every instantiation below, so the switch and the method test fold away
+// and each instantiation is straight-line code for one type.
+static inline LogicValue eval_typed(const Simulator* sim, int gate_id, GateType type,
+                                    int use_lookup_table, int shared) {
+    const int* fanins = sim_fanins(sim, gate_id);
+    int count = sim_fanin_count(sim, gate_id);
+    if (count == 0) {
         return VALUE_X;
     }
 
-    LogicValue v;
-    
-    switch (gate->type) {
+    switch (type) {
+        case GATE_AND:
+            return use_lookup_table ? eval_wide(sim, fanins, count, 0, 0, shared)
+                                    : eval_controlling(sim, fanins, count, 0, 0, shared);
+        case GATE_NAND:
+            return use_lookup_table ? eval_wide(sim, fanins, count, 0, 1, shared)
+                                    : eval_controlling(sim, fanins, count, 0, 1, shared);
+        case GATE_OR:
+            return use_lookup_table ? eval_wide(sim, fanins, count, 1, 0, shared)
+                                    : eval_controlling(sim, fanins, count, 1, 0, shared);
+        case GATE_NOR:
+            return use_lookup_table ? eval_wide(sim, fanins, count, 1, 1, shared)
+                                    : eval_controlling(sim, fanins, count, 1, 1, shared);
+        case GATE_XOR:
+            return eval_wide(sim, fanins, count, 2, 0, shared);
+        case GATE_XNOR:
+            return eval_wide(sim, fanins, count, 2, 1, shared);
         case GATE_NOT:
-            return not_table[all_gates[gate->fanins[0]].state];
+            return not_table[fanin_state(sim, fanins[0], shared)];
         case GATE_BUF:
-            return all_gates[gate->fanins[0]].state;
         case GATE_WIRE:
-            if (gate->fanin_count > 0)
-                return all_gates[gate->fanins[0]].state;
+            return fanin_state(sim, fanins[0], shared);
+        default:
             return VALUE_X;
+    }
+}
 
-        case GATE_AND:
-        case GATE_OR:
-        case GATE_NAND:
-        case GATE_NOR:
-        case GATE_XOR:
-        case GATE_XNOR: {
-            LogicValue (*table)[3];
-            
-            switch(gate->type) {
-                case GATE_AND: table = and_table; break;
-                case GATE_OR: table = or_table; break;
-                case GATE_NAND: table = nand_table; break;
-                case GATE_NOR: table = nor_table; break;
-                case GATE_XOR: table = xor_table; break;
-                case GATE_XNOR: table = xnor_table; break;
-                default: return VALUE_X;
-            }
+// evaluates a run of gates of one type, returns the fanout events raised
+static inline long sweep_typed(Simulator* sim, const int* ids, int count, GateType type,
+                               int use_lookup_table) {
+    long events = 0;
+    for (int i = 0; i < count; i++) {
+        int gaten = ids[i];
+        LogicValue new_value = eval_typed(sim, gaten, type, use_lookup_table, 0);
+
+        if (new_value != sim_get_state(sim, gaten)) {
+            sim_set_state(sim, gaten, new_value);
+            events += sim_fanout_count(sim, gaten);
+        }
+    }
+    return events;
+}
+
+// per gate type: one run sweeper for each method
+#define GATE_SPECIALIZATIONS(type) \
+    static long sweep_scan_##type(Simulator* sim, const int* ids, int count) { \
+        return sweep_typed(sim, ids, count, type, 0); \
+    } \
+    static long sweep_table_##type(Simulator* sim, const int* ids, int count) { \
+        return sweep_typed(sim, ids, count, type, 1); \
+    }
+
+GATE_SPECIALIZATIONS(GATE_INPUT)
+GATE_SPECIALIZATIONS(GATE_OUTPUT)
+GATE_SPECIALIZATIONS(GATE_AND)
+GATE_SPECIALIZATIONS(GATE_NAND)
+GATE_SPECIALIZATIONS(GATE_OR)
+GATE_SPECIALIZATIONS(GATE_NOR)
+GATE_SPECIALIZATIONS(GATE_XOR)
+GATE_SPECIALIZATIONS(GATE_XNOR)
+GATE_SPECIALIZATIONS(GATE_BUF)
+GATE_SPECIALIZATIONS(GATE_NOT)
+GATE_SPECIALIZATIONS(GATE_DFF)
+GATE_SPECIALIZATIONS(GATE_WIRE)
+
+#define GATE_TABLE(prefix) { \
+    prefix##GATE_INPUT, prefix##GATE_OUTPUT, prefix##GATE_AND, prefix##GATE_NAND, \
+    prefix##GATE_OR, prefix##GATE_NOR, prefix##GATE_XOR, prefix##GATE_XNOR, \
+    prefix##GATE_BUF, prefix##GATE_NOT, prefix##GATE_DFF, prefix##GATE_WIRE }
+
+// indexed by [use_lookup_table][type]
+static const GateSweepFn gate_sweepers[2][GATE_TYPE_COUNT] = {
+    GATE_TABLE(sweep_scan_), GATE_TABLE(sweep_table_)
+};
+
+// wide table and inversion per gate type, -1 where there is none
+static const int8_t wide_op[GATE_TYPE_COUNT] = {
+    [GATE_INPUT] = -1, [GATE_OUTPUT] = -1, [GATE_AND] = 0, [GATE_NAND] = 0,
+    [GATE_OR] = 1, [GATE_NOR] = 1, [GATE_XOR] = 2, [GATE_XNOR] = 2,
+    [GATE_BUF] = -1, [GATE_NOT] = -1, [GATE_DFF] = -1, [GATE_WIRE] = -1
+};
+static const uint8_t wide_inverted[GATE_TYPE_COUNT] = {
+    [GATE_NAND] = 1, [GATE_NOR] = 1, [GATE_XNOR] = 1
+};
+
+// One gate of any type. The switch picks an inlined eval_typed, so callers
+// such as the event loop keep evaluation in line rather than making an
+// indirect call per gate.
+static inline LogicValue eval_dispatch(const Simulator* sim, int gate_id, int use_lookup_table,
+                                       int shared) {
+    GateType type = (GateType)sim->type[gate_id];
+    int op = wide_op[type];
+    // table lookups share one copy of the chunk loop; with mixed gate
+    // types that predicts better than a copy per type
+    if (op >= 0 && (use_lookup_table || op == 2)) {
+        int count = sim_fanin_count(sim, gate_id);
+        if (count == 0) {
+            return VALUE_X;
+        }
+        return eval_wide(sim, sim_fanins(sim, gate_id), count, op, wide_inverted[type], shared);
+    }
+    switch (type) {
+        case GATE_AND:  return eval_typed(sim, gate_id, GATE_AND, 0, shared);
+        case GATE_NAND: return eval_typed(sim, gate_id, GATE_NAND, 0, shared);
+        case GATE_OR:   return eval_typed(sim, gate_id, GATE_OR, 0, shared);
+        case GATE_NOR:  return eval_typed(sim, gate_id, GATE_NOR, 0, shared);
+        case GATE_NOT:  return eval_typed(sim, gate_id, GATE_NOT, 0, shared);
+        case GATE_BUF:
+        case GATE_WIRE: return eval_typed(sim, gate_id, GATE_BUF, 0, shared);
+        default:        return VALUE_X;
+    }
+}
+
+LogicValue evaluate_input_scan(const Simulator* sim, int gate_id) {
+    return eval_dispatch(sim, gate_id, 0, 0);
+}
 
-            v = table[all_gates[gate->fanins[0]].state][all_gates[gate->fanins[1]].state];
-            for (int i = 2; i < gate->fanin_count; i++) {
-                v = table[v][all_gates[gate->fanins[i]].state];
+LogicValue evaluate_lookup_table(const Simulator* sim, int gate_id) {
+    return eval_dispatch(sim, gate_id, 1, 0);
+}
+
+LogicValue evaluate_input_scan_shared(const Simulator* sim, int gate_id) {
+    return eval_dispatch(sim, gate_id, 0, 1);
+}
+
+LogicValue evaluate_lookup_table_shared(const Simulator* sim, int gate_id) {
+    return eval_dispatch(sim, gate_id, 1, 1);
+}
+
+// gates per window that level_order groups by type
+#define LEVEL_ORDER_TYPE_WINDOW 1024
+
+static int in_level_order(const Simulator* sim, int i) {
+    return !(sim->flags[i] & (SIM_INPUT | SIM_DFF)) && sim_fanin_count(sim, i) > 0 &&
+           sim->level[i] >= 0;
+}
+
+// Fills order with the gates an oblivious sweep evaluates, sorted by level
+// (counting sort), and returns how many there are. Within a level, gates
+// stay in id order but every window of LEVEL_ORDER_TYPE_WINDOW of them is
+// grouped by type: long runs of one type let the type branch predict,
+// while the window keeps state and CSR accesses close together on circuits
+// that do not fit in cache. Inputs and DFFs are sources; gates with no
+// fanins or no level (combinational loops) are never scheduled by the
+// event-driven core either, so they stay X.
+int level_order(Simulator* sim, int* order) {
+    int* level_start = (int*)calloc(sim->max_level + 2, sizeof(int));
+    int* window = (int*)malloc(LEVEL_ORDER_TYPE_WINDOW * sizeof(int));
+    if (!level_start || !window) {
+        exit(1);
+    }
+
+    int count = 0;
+    for (int i = 0; i < sim->gate_count; i++) {
+        if (in_level_order(sim, i)) {
+            level_start[sim->level[i] + 1]++;
+            count++;
+        }
+    }
+    for (int level = 0; level <= sim->max_level; level++) {
+        level_start[level + 1] += level_start[level];
+    }
+    for (int i = 0; i < sim->gate_count; i++) {
+        if (in_level_order(sim, i)) {
+            order[level_start[sim->level[i]]++] = i;
+        }
+    }
+
+    // level_start[level] is now the end of the level
+    int begin = 0;
+    for (int level = 0; level <= sim->max_level; level++) {
+        int end = level_start[level];
+        for (int w = begin; w < end; w += LEVEL_ORDER_TYPE_WINDOW) {
+            int n = end - w < LEVEL_ORDER_TYPE_WINDOW ? end - w : LEVEL_ORDER_TYPE_WINDOW;
+            int type_start[GATE_TYPE_COUNT + 1] = { 0 };
+            for (int k = 0; k < n; k++) {
+                type_start[sim->type[order[w + k]] + 1]++;
+            }
+            for (int t = 0; t < GATE_TYPE_COUNT; t++) {
+                type_start[t + 1] += type_start[t];
+            }
+            for (int k = 0; k < n; k++) {
+                window[type_start[sim->type[order[w + k]]]++] = order[w + k];
             }
-            return v;
+            memcpy(order + w, window, n * sizeof(int));
         }
-        default:
-            return VALUE_X;
+        begin = end;
     }
+
+    free(window);
+    free(level_start);
+    return count;
 }
 
 void print_state(Simulator* sim, int cycle) {
@@ -311,109 +627,185 @@ void print_state(Simulator* sim, int cycle) {
     printf("\nInputs:\n");
     for (int i = 0; i < sim->input_count; i++) {
         int indx = sim->input_indices[i];
-        printf("%s", logic_value_str(sim->gates[indx].state));
+        printf("%s", logic_value_str(sim_get_state(sim, indx)));
     }
     printf(" ");
     
     printf("\nOutputs:\n");
     for (int i = 0; i < sim->output_count; i++) {
         int indx = sim->output_indices[i];
-        printf("%s", logic_value_str(sim->gates[indx].state));
+        printf("%s", logic_value_str(sim_get_state(sim, indx)));
     }
     printf(" ");
     
     printf("\nStates:\n");
     for (int i = 0; i < sim->dff_count; i++) {
         int indx = sim->dff_indices[i];
-        printf("%s", logic_value_str(sim->gates[indx].state));
+        printf("%s", logic_value_str(sim_get_state(sim, indx)));
     }
     printf("\n\n\n");
 }
 
-void simulate(Simulator* sim, int use_lookup_table) {
-    char input_str[256];
+static inline long evaluate_events_typed(Simulator* sim, int use_lookup_table) {
+    long events = 0;
+    for (int level = 0; level <= sim->max_level; level++) {
+        int gaten = sim->levels[level];
+        
+        while (gaten != sim->dummy_gate_id) {
+            LogicValue new_value = eval_dispatch(sim, gaten, use_lookup_table, 0);
+
+            if (new_value != sim_get_state(sim, gaten)) {
+                sim_set_state(sim, gaten, new_value);
+                schedule_fanout(gaten, sim);
+                events += sim_fanout_count(sim, gaten);
+            }
+            
+            int next_id = sim->sched[gaten];
+            sim->sched[gaten] = -1;
+
+            if (next_id != -1) {
+                gaten = next_id;
+            } else {
+                gaten = sim->dummy_gate_id;
+            }
+        }
+        
+        sim->levels[level] = sim->dummy_gate_id;
+    }
+    return events;
+}
+
+// Event-driven pass over the level lists. Returns the number of fanout
+// events raised, the activity measure used by the hybrid scheduler.
+long evaluate_events(Simulator* sim, int use_lookup_table) {
+    return use_lookup_table ? evaluate_events_typed(sim, 1) : evaluate_events_typed(sim, 0);
+}
+
+// Splits the level order into runs of one gate type and binds each run to
+// the sweeper for its type and the chosen method.
+void init_sweep_plan(SweepPlan* plan, Simulator* sim, int use_lookup_table) {
+    plan->order = (int*)malloc((sim->gate_count + 1) * sizeof(int));
+    if (!plan->order) {
+        exit(1);
+    }
+    plan->order_count = level_order(sim, plan->order);
+
+    plan->runs = (SweepRun*)malloc((plan->order_count + 1) * sizeof(SweepRun));
+    if (!plan->runs) {
+        exit(1);
+    }
+    plan->run_count = 0;
+    for (int i = 0; i < plan->order_count; i++) {
+        uint8_t type = sim->type[plan->order[i]];
+        if (i > 0 && type == sim->type[plan->order[i - 1]]) {
+            plan->runs[plan->run_count - 1].count++;
+            continue;
+        }
+        SweepRun* run = &plan->runs[plan->run_count++];
+        run->sweep = gate_sweepers[use_lookup_table ? 1 : 0][type];
+        run->ids = plan->order + i;
+        run->count = 1;
+    }
+}
+
+// Oblivious pass: every gate in level order, nothing is scheduled. Counts
+// the fanout events an event-driven pass would have raised.
+long sweep_plan_run(SweepPlan* plan, Simulator* sim) {
+    long events = 0;
+    for (int r = 0; r < plan->run_count; r++) {
+        const SweepRun* run = &plan->runs[r];
+        events += run->sweep(sim, run->ids, run->count);
+    }
+    return events;
+}
+
+void free_sweep_plan(SweepPlan* plan) {
+    free(plan->order);
+    free(plan->runs);
+    plan->order = NULL;
+    plan->runs = NULL;
+    plan->order_count = 0;
+    plan->run_count = 0;
+}
+
+// Shared cycle loop. With threshold < 0 every cycle is event-driven.
+// Otherwise a cycle is swept when the previous one raised more than
+// threshold fanout events per combinational gate; both passes leave the
+// level lists empty, so the mode can change on any cycle. With parallel
+// set, the event-driven passes run on its worker threads.
+static void run_simulation(Simulator* sim, SimIO* io, int use_lookup_table, double threshold,
+                           ParallelSim* parallel) {
+    const uint8_t* inputs;
     int cycle = 0;
+    int sweep_cycles = 0;
+
+    SweepPlan plan = { 0 };
+    if (threshold >= 0) {
+        init_sweep_plan(&plan, sim, use_lookup_table);
+    }
+    int sweep = 0;
 
     clock_t start_time = clock();
     
     while (1) {
-        print_state(sim, cycle);
+        sim_io_state(io, sim, cycle);
         
-        printf("Inputs: \n");
-        if (scanf("%s", input_str) != 1) {
+        sim_io_prompt(io);
+        int input_count = sim_io_next(io, &inputs);
+        if (input_count < 0) {
             break;
         }
 
-        if (input_str[0] == 'q' || input_str[0] == 'Q') {
-            break;
-        }
+        long events = 0;
 
         // load new inputs and schedule fanouts if changed
-        for (int i = 0; i < sim->input_count && i < strlen(input_str); i++) {
+        for (int i = 0; i < input_count; i++) {
             int indx = sim->input_indices[i];
-            LogicValue old_value = sim->gates[indx].state;
+            LogicValue old_value = sim_get_state(sim, indx);
 
-            if (input_str[i] == '0') {
-                sim->gates[indx].state = VALUE_0;
-            }
-            else if (input_str[i] == '1') {
-                sim->gates[indx].state = VALUE_1;
-            }
-            else {
-                sim->gates[indx].state = VALUE_X;
-            }
+            sim_set_state(sim, indx, (LogicValue)inputs[i]);
 
-            if (sim->gates[indx].state != old_value) {
-                schedule_fanout(indx, sim);
+            if (sim_get_state(sim, indx) != old_value) {
+                if (!sweep) {
+                    schedule_fanout(indx, sim);
+                }
+                events += sim_fanout_count(sim, indx);
             }
         }
         
         for (int i = 0; i < sim->dff_count; i++) {
             int indx = sim->dff_indices[i];
-            LogicValue old_value = sim->gates[indx].state;
-            sim->gates[indx].state = sim->gates[indx].next_state;
+            LogicValue old_value = sim_get_state(sim, indx);
+            sim_set_state(sim, indx, (LogicValue)sim->dff_next[i]);
 
-            if (sim->gates[indx].state != old_value) {
-                schedule_fanout(indx, sim);
+            if (sim_get_state(sim, indx) != old_value) {
+                if (!sweep) {
+                    schedule_fanout(indx, sim);
+                }
+                events += sim_fanout_count(sim, indx);
             }
         }
         
-        for (int level = 0; level <= sim->max_level; level++) {
-            SimGate* gaten = sim->levels[level];
-            
-            while (gaten->id != sim->dummy_gate_id) {
-                LogicValue new_value;
-                if (use_lookup_table) {
-                    new_value = evaluate_lookup_table(gaten, sim->gates);
-                } else {
-                    new_value = evaluate_input_scan(gaten, sim->gates);
-                }
-
-                if (new_value != gaten->state) {
-                    gaten->state = new_value;
-                    schedule_fanout(gaten->id, sim);
-                }
-                
-                int next_id = gaten->sched;
-                gaten->sched = -1;
-
-                if (next_id != -1 && next_id != sim->dummy_gate_id) {
-                    gaten = &sim->gates[next_id];
-                } else {
-                    gaten = &sim->gates[sim->dummy_gate_id];
-                }
-            }
-            
-            sim->levels[level] = &sim->gates[sim->dummy_gate_id];
+        if (sweep) {
+            events += sweep_plan_run(&plan, sim);
+            sweep_cycles++;
+        } else if (parallel) {
+            events += parallel_events(parallel);
+        } else {
+            events += evaluate_events(sim, use_lookup_table);
         }
 
         for (int i = 0; i < sim->dff_count; i++) {
             int indx = sim->dff_indices[i];
-            if (sim->gates[indx].fanin_count > 0) {
-                int d_input_indx = sim->gates[indx].fanins[0];
-                sim->gates[indx].next_state = sim->gates[d_input_indx].state;
+            if (sim_fanin_count(sim, indx) > 0) {
+                int d_input_indx = sim_fanins(sim, indx)[0];
+                sim->dff_next[i] = sim_get_state(sim, d_input_indx);
             }
         }
+
+        if (threshold >= 0) {
+            sweep = events > threshold * plan.order_count;
+        }
         
         cycle++;
     }
@@ -421,10 +813,43 @@ void simulate(Simulator* sim, int use_lookup_table) {
     clock_t end_time = clock();
     double cpu_time = ((double)(end_time - start_time)) / CLOCKS_PER_SEC;
 
-    printf("\nSimulation Complete!\n");
-    printf("Total cycles: %d\n", cycle);
-    printf("CPU Time: %.6f seconds\n", cpu_time);
-    printf("Method: %s\n", use_lookup_table ? "Table Lookup" : "Input Scanning");
+    int report_method = sim_io_report(io, cycle, cpu_time);
+    if (report_method && parallel) {
+        printf("Method: Parallel %s (%d threads, %s)\n",
+               use_lookup_table ? "Table Lookup" : "Input Scanning", parallel->thread_count,
+               parallel->mode == PARALLEL_STEAL ? "work stealing" :
+               parallel->mode == PARALLEL_PARTITIONED ? "partitioned" : "level-synchronous");
+    } else if (report_method && threshold >= 0) {
+        printf("Method: Hybrid %s (threshold %.3f, %d event-driven, %d swept cycles)\n",
+               use_lookup_table ? "Table Lookup" : "Input Scanning", threshold,
+               cycle - sweep_cycles, sweep_cycles);
+    } else if (report_method) {
+        printf("Method: %s\n", use_lookup_table ? "Table Lookup" : "Input Scanning");
+    }
+
+    free_sweep_plan(&plan);
+}
+
+void simulate(Simulator* sim, SimIO* io, int use_lookup_table) {
+    run_simulation(sim, io, use_lookup_table, -1, NULL);
+}
+
+// Event-driven while activity is low, full level sweeps while it is high.
+// threshold is in fanout events per combinational gate per cycle.
+void simulate_hybrid(Simulator* sim, SimIO* io, int use_lookup_table, double threshold) {
+    run_simulation(sim, io, use_lookup_table, threshold < 0 ? 0 : threshold, NULL);
+}
+
+// Event-driven like simulate, with each pass spread over threads workers.
+void simulate_parallel(Simulator* sim, SimIO* io, int use_lookup_table, int threads,
+                       ParallelMode mode) {
+    ParallelSim ps;
+    init_parallel_sim(&ps, sim, threads, use_lookup_table, mode);
+    run_simulation(sim, io, use_lookup_table, -1, &ps);
+    if (mode == PARALLEL_PARTITIONED && !io->quiet) {
+        print_partition_report(&ps);
+    }
+    free_parallel_sim(&ps);
 }
 
 const char* logic_value_str(LogicValue v) {
@@ -437,17 +862,28 @@ const char* logic_value_str(LogicValue v) {
 }
 
 void free_simulator(Simulator* sim) {
-    for (int i = 0; i <= sim->gate_count; i++) {
-        if (sim->gates[i].name) free(sim->gates[i].name);
-        if (sim->gates[i].fanins) free(sim->gates[i].fanins);
-        if (sim->gates[i].fanouts) free(sim->gates[i].fanouts);
+    if (sim->mapping) {
+        // connectivity, types, levels and names live in the mapping
+        munmap(sim->mapping, sim->mapping_size);
+    } else {
+        free(sim->type);
+        free(sim->level);
+        free(sim->fanin_start);
+        free(sim->fanins);
+        free(sim->fanout_start);
+        free(sim->fanouts);
+        free(sim->names);
+        free(sim->name_offsets);
     }
 
-    if (sim->gates) free(sim->gates);
-    if (sim->input_indices) free(sim->input_indices);
-    if (sim->output_indices) free(sim->output_indices);
-    if (sim->dff_indices) free(sim->dff_indices);
-    if (sim->levels) free(sim->levels);
+    free(sim->state);
+    free(sim->sched);
+    free(sim->flags);
+    free(sim->input_indices);
+    free(sim->output_indices);
+    free(sim->dff_indices);
+    free(sim->dff_next);
+    free(sim->levels);
 
     init_simulator(sim);
-}
\ No newline at end of file
+}
@@ -1,6 +1,8 @@
 #ifndef SIMULATOR_H
 #define SIMULATOR_H
 
+#include <stdio.h>
+#include <pthread.h>
 #include "circuit.h"
 
 // Logic value
@@ -10,58 +12,455 @@ typedef enum {
     VALUE_X = 2
 } LogicValue;
 
-typedef struct SimGate {
-    int id;
-    GateType type;
-    char* name;
-    int is_input;
-    int is_output;
-    int is_dff;
-    int level;
+// Signal state storage. By default every signal is one byte. Building with
+// -DSIM_PACKED_STATE (make PACKED=1) packs 2 bits per signal, 32 signals per
+// 64-bit word, so the state of a large design takes a quarter of the space.
+// Always go through sim_get_state/sim_set_state.
+#ifdef SIM_PACKED_STATE
+typedef uint64_t SimStateWord;
+#define SIM_STATE_WORDS(n) (((size_t)(n) + 31) / 32)
+#define SIM_STATE_ALL_X 0xAA    // byte of four VALUE_X fields
+#else
+typedef uint8_t SimStateWord;
+#define SIM_STATE_WORDS(n) ((size_t)(n))
+#define SIM_STATE_ALL_X VALUE_X
+#endif
 
-    int* fanins;
-    int fanin_count;
-    int* fanouts;
-    int fanout_count;
+#define GATE_TYPE_COUNT (GATE_WIRE + 1)
 
-    LogicValue state;
-    LogicValue next_state;
-    int sched; // pointer to next gate, initialized as -1 starting (if not scheduled)
-} SimGate;
+// per-gate flags
+#define SIM_INPUT  0x1
+#define SIM_OUTPUT 0x2
+#define SIM_DFF    0x4
 
-// Simulator circuit struct
+// Simulator circuit struct. Gates are stored as a structure of arrays
+// indexed by gate id, so evaluation only touches the arrays it needs. The
+// fanins of gate i are fanins[fanin_start[i]] .. fanins[fanin_start[i + 1] - 1]
+// (CSR), and likewise for fanouts. Names are kept off to the side.
 typedef struct Simulator {
-    SimGate* gates;
     int gate_count;
     int input_count;
     int output_count;
     int dff_count;
     int max_level;
 
+    // hot, per gate (gate_count + 1 entries, the last is the dummy gate)
+    SimStateWord* state;    // LogicValue, see sim_get_state
+    int* sched;             // next scheduled gate at the same level, -1 if not scheduled
+
+    // read-only circuit, per gate
+    uint8_t* type;          // GateType
+    uint8_t* flags;         // SIM_INPUT | SIM_OUTPUT | SIM_DFF
+    int* level;
+    int* fanin_start;       // gate_count + 1 offsets into fanins
+    int* fanins;
+    int* fanout_start;      // gate_count + 1 offsets into fanouts
+    int* fanouts;
+
+    // cold: names[name_offsets[i]] is the NUL-terminated name of gate i
+    char* names;
+    uint32_t* name_offsets;
+
     int* input_indices;
     int* output_indices;
     int* dff_indices;
+    uint8_t* dff_next;      // next state, per entry of dff_indices
 
-    SimGate** levels;
+    int* levels;            // head of the schedule per level, dummy_gate_id when empty
     int dummy_gate_id;
+
+    void* mapping;          // mapped binary circuit file, NULL for text input
+    size_t mapping_size;
 } Simulator;
 
+static inline int sim_fanin_count(const Simulator* sim, int gate_id) {
+    return sim->fanin_start[gate_id + 1] - sim->fanin_start[gate_id];
+}
+
+static inline const int* sim_fanins(const Simulator* sim, int gate_id) {
+    return sim->fanins + sim->fanin_start[gate_id];
+}
+
+static inline int sim_fanout_count(const Simulator* sim, int gate_id) {
+    return sim->fanout_start[gate_id + 1] - sim->fanout_start[gate_id];
+}
+
+// value of gate_id in a state array laid out like sim->state
+static inline LogicValue sim_state_value(const SimStateWord* state, int gate_id) {
+#ifdef SIM_PACKED_STATE
+    return (LogicValue)((state[gate_id >> 5] >> ((gate_id & 31) * 2)) & 3);
+#else
+    return (LogicValue)state[gate_id];
+#endif
+}
+
+static inline LogicValue sim_get_state(const Simulator* sim, int gate_id) {
+    return sim_state_value(sim->state, gate_id);
+}
+
+static inline void sim_set_state(Simulator* sim, int gate_id, LogicValue v) {
+#ifdef SIM_PACKED_STATE
+    int shift = (gate_id & 31) * 2;
+    SimStateWord* w = &sim->state[gate_id >> 5];
+    *w = (*w & ~((SimStateWord)3 << shift)) | ((SimStateWord)v << shift);
+#else
+    sim->state[gate_id] = (uint8_t)v;
+#endif
+}
+
+// For passes where several threads set signals at once (parallel_sim.c).
+// A packed word holds 32 signals, so the field is flipped with one atomic
+// xor; old must be the signal's current value.
+static inline void sim_set_state_shared(Simulator* sim, int gate_id, LogicValue old, LogicValue v) {
+#ifdef SIM_PACKED_STATE
+    SimStateWord flip = (SimStateWord)(old ^ v) << ((gate_id & 31) * 2);
+    __atomic_fetch_xor(&sim->state[gate_id >> 5], flip, __ATOMIC_RELAXED);
+#else
+    (void)old;
+    sim->state[gate_id] = (uint8_t)v;
+#endif
+}
+
+// Reads in those passes. Other threads may be flipping fields of the same
+// packed word, so the word is loaded atomically.
+static inline LogicValue sim_get_state_shared(const Simulator* sim, int gate_id) {
+#ifdef SIM_PACKED_STATE
+    SimStateWord w = __atomic_load_n(&sim->state[gate_id >> 5], __ATOMIC_RELAXED);
+    return (LogicValue)((w >> ((gate_id & 31) * 2)) & 3);
+#else
+    return sim_get_state(sim, gate_id);
+#endif
+}
+
+static inline const char* sim_gate_name(const Simulator* sim, int gate_id) {
+    return sim->names + sim->name_offsets[gate_id];
+}
+
+// Pattern-parallel simulation (pattern_sim.c): one bit per lane, dual-rail.
+// Each signal has `words` 64-bit words of "is 1" bits (hi) followed by as
+// many of "is 0" bits (lo); neither set is X. The width is 64 lanes, or 256
+// and 512 with the AVX2 and AVX-512 kernels.
+#define PATTERN_WORD_LANES 64
+#define PATTERN_MAX_WORDS 8
+
+typedef struct PatternSim PatternSim;
+typedef void (*pattern_step_fn)(PatternSim* ps);
+
+struct PatternSim {
+    Simulator* sim;
+    int words;              // 64-bit words per rail
+    int lanes;              // words * PATTERN_WORD_LANES
+    const char* kernel;     // name of the selected kernel
+    pattern_step_fn step;
+    uint64_t* values;       // per gate, hi words then lo words
+    uint64_t* next_dff;     // per entry of dff_indices, same layout
+    int* order;             // gates to evaluate, in level order
+    int order_count;
+};
+
+// Levelized bytecode (bytecode_sim.c): the combinational logic lowered to a
+// flat stream of 32-bit words, one instruction per gate in level order. An
+// instruction is an opcode, the output slot and the input slots; n-input
+// gates also carry their fanin count. Slots index values, one byte per gate.
+typedef enum {
+    BC_AND2, BC_NAND2, BC_OR2, BC_NOR2, BC_XOR2, BC_XNOR2,  // op, out, a, b
+    BC_AND, BC_NAND, BC_OR, BC_NOR, BC_XOR, BC_XNOR,        // op, out, n, in...
+    BC_BUF, BC_NOT,                                         // op, out, a
+    BC_X,                                                   // op, out
+    BC_HALT,
+    BC_OP_COUNT
+} BytecodeOp;
+
+typedef struct BytecodeSim {
+    Simulator* sim;
+    int32_t* code;
+    int code_size;
+    uint8_t* values;        // per gate LogicValue
+    uint8_t* next_dff;      // per entry of dff_indices
+} BytecodeSim;
+
+// Hybrid scheduling: a cycle is swept in level order instead of event-driven
+// when the previous cycle raised more than this many fanout events per
+// combinational gate
+#define HYBRID_DEFAULT_THRESHOLD 0.25
+
+// Multi-threaded event-driven passes (parallel_sim.c). PARALLEL_LEVELS
+// runs the levels one after another with a barrier between them;
+// PARALLEL_STEAL orders them with per-level pending counters and lets idle
+// workers steal. Both schedule lock-free: a test-and-set on sched, then an
+// append to the claiming worker's own buffer for the level.
+// PARALLEL_PARTITIONED gives each worker a part of the circuit
+// (partition.c) with its own copy of the state it reads and its own
+// queues, and exchanges values across the cut once per level band.
+#define PARALLEL_MAX_THREADS 64
+
+typedef enum {
+    PARALLEL_LEVELS,
+    PARALLEL_STEAL,
+    PARALLEL_PARTITIONED
+} ParallelMode;
+
+// one worker's gates for one level; only the owner appends
+typedef struct LevelQueue {
+    int* ids;
+    int count;
+    int capacity;
+    int next;               // first gate not yet taken, by any worker
+} LevelQueue;
+
+typedef struct ParallelWorker ParallelWorker;
+
+// a changed value for a copy held by another partition
+typedef struct BoundaryValue {
+    int slot;               // local id of the copy
+    int value;
+} BoundaryValue;
+
+typedef struct BoundaryBuffer {
+    BoundaryValue* items;
+    int count;
+    int capacity;
+} BoundaryBuffer;
+
+// One part of a partitioned circuit. view holds the part's gates in local
+// ids, its own gates first (in level order) and then copies of the gates
+// they read from other parts; only state, type, level and the fanin CSR
+// are filled in, which is all the evaluators use.
+typedef struct Partition {
+    Simulator view;
+    int owned_count;
+    int local_count;
+    int* global_id;         // per local id
+    int* fanout_start;      // local readers of each local gate
+    int* fanouts;
+    int* sources;           // local ids of inputs and DFFs, refreshed every pass
+    int source_count;
+    int* level_start;       // queue[level_start[l] ...] holds level l's scheduled gates
+    int* queue;
+    int* queue_count;
+    uint8_t* queued;
+    BoundaryBuffer* outbox; // [band parity * parts + destination part]
+    long load;              // sum of 1 + fanin count over own gates
+} Partition;
+
+typedef struct ParallelSim {
+    Simulator* sim;
+    ParallelMode mode;
+    int use_lookup_table;
+    int thread_count;
+    pthread_t* threads;
+    ParallelWorker* workers;
+    pthread_barrier_t start;        // workers and caller, once per pass
+    pthread_barrier_t done;
+    pthread_barrier_t level_barrier; // workers, between levels
+    int stop;
+    long* events;                   // per worker, last pass
+
+    LevelQueue* local;      // local[worker * levels + level]
+    int* level_active;      // per level, anything queued (PARALLEL_LEVELS)
+    int* pending;           // per level, queued and not yet evaluated (PARALLEL_STEAL)
+    int frontier;           // lowest level with pending gates (PARALLEL_STEAL)
+
+    // PARALLEL_PARTITIONED, one part per worker
+    int* part;              // per gate, owning part
+    int* local_id;          // per gate, local id in its own part
+    Partition* parts;
+    int* remote_start;      // per gate, copies held by other parts
+    int* remote_part;
+    int* remote_slot;
+    int* band_last;         // last level of each band
+    int band_count;
+    long cut_edges;         // fanin edges between parts
+    long boundary_values;   // (gate, other part) pairs exchanged
+} ParallelSim;
+
+// Sweeps a run of gates of one type, specialized per type and method
+// (simulator.c), so the loop body has no method or type branches.
+typedef long (*GateSweepFn)(Simulator* sim, const int* ids, int count);
+
+// A full sweep in level order, split into runs of gates of one type so
+// every run is a homogeneous loop.
+typedef struct SweepRun {
+    GateSweepFn sweep;
+    const int* ids;
+    int count;
+} SweepRun;
+
+typedef struct SweepPlan {
+    int* order;             // level_order, grouped by type within a level
+    int order_count;
+    SweepRun* runs;
+    int run_count;
+} SweepPlan;
+
+// VCD waveform tracing (vcd.c). Each cycle the state is compared with the
+// previous cycle's copy a word at a time, and the traced signals that
+// changed go into a single-producer ring buffer. A writer thread formats
+// them, so the simulation thread never formats or writes.
+#define VCD_RING_SIZE (1 << 20)     // entries, a power of 2
+
+typedef struct VcdTrace {
+    Simulator* sim;
+    FILE* out;
+    int signal_count;
+    int* trace_index;       // per gate, -1 if not traced
+    char (*codes)[5];       // VCD identifier per traced signal, NUL-terminated
+    SimStateWord* prev;     // state at the previous cycle
+    size_t state_bytes;
+    int started;
+    int cycle;              // last traced
+    int finished;
+    long changes;
+
+    uint32_t* ring;
+    size_t head_local;      // producer: pushed, not yet published
+    size_t tail_seen;       // producer: last tail it read
+    size_t head __attribute__((aligned(64)));  // published by the producer
+    size_t tail __attribute__((aligned(64)));  // consumed by the writer
+    int waiting __attribute__((aligned(64)));  // writer is asleep on wake
+    int done;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+} VcdTrace;
+
+// Stimulus and response streams (sim_io.c). Interactive runs prompt for
+// vectors on stdin. Batch runs read a stimulus file (mapped; "-" reads
+// stdin), either text vectors of any width or the binary format below, and
+// write the cycle states to a buffered response file, as text or binary.
+// Quiet runs print only the cycles per second, and drop the cycle states
+// unless they have a response file.
+#define SIM_IO_QUIET  0x1   // just cycles per second on the console
+#define SIM_IO_BINARY 0x2   // binary responses
+#define SIM_IO_RLE    0x4   // run-length encode binary responses
+
+typedef struct SimIO {
+    int batch;
+    int quiet;
+    int no_states;          // quiet without a response file: states dropped
+    char* data;             // whole stimulus
+    size_t size;
+    size_t pos;
+    int mapped;
+    int binary_in;
+    int in_signals;         // per binary stimulus record
+    size_t in_record;       // bytes per binary stimulus record
+    uint32_t repeats_left;  // of the current binary stimulus record
+    int input_count;
+    uint8_t* values;        // current input vector, LogicValue per input
+    char* token;            // interactive vector, grown as needed
+    size_t token_size;
+    FILE* out;              // responses
+    int binary_out;
+    int rle;
+    char* state_buf;        // one formatted cycle state, or binary record
+    size_t state_buf_size;
+    char* prev_record;      // last binary record, not written until its run ends
+    size_t out_record;
+    uint32_t run;
+    VcdTrace* trace;        // waveform, NULL if not tracing
+    int started;
+    double start;           // wall clock at the first vector
+} SimIO;
+
+// Binary stimulus and response files (sim_io.c, sim_vectors). A header,
+// then one record per cycle: a uint32_t repeat count (the record stands
+// for that many cycles in a row, 1 unless run-length encoded) and the
+// signals at 2 bits each, four to a byte, first signal in the low bits.
+// A signal is a LogicValue; in stimulus files SIM_VECTOR_KEEP leaves the
+// input as it was, like the missing end of a short text vector. Response
+// records hold the inputs, outputs and DFFs in print_state's order, from
+// cycle 0 on. Native-endian, like the binary circuit file.
+#define SIM_STIMULUS_MAGIC 0x53565a4cu  // "LZVS"
+#define SIM_RESPONSE_MAGIC 0x52565a4cu  // "LZVR"
+#define SIM_VECTOR_VERSION 1
+#define SIM_VECTOR_KEEP    3
+
+#define SIM_VECTOR_FLAG_RLE 0x1
+
+typedef struct SimVectorHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t signal_count;      // per record
+    uint32_t input_count;       // responses: the record's sections
+    uint32_t output_count;
+    uint32_t dff_count;
+    uint32_t flags;             // SIM_VECTOR_FLAG_*
+    uint32_t reserved;
+} SimVectorHeader;
+
+#define SIM_VECTOR_RECORD(signals) (sizeof(uint32_t) + ((size_t)(signals) + 3) / 4)
+
 // necessary function prototypes
 void init_simulator(Simulator* sim);
 void load_circuit_file(const char* filename, Simulator* sim);
+void load_circuit_binary(const char* filename, Simulator* sim);
 void init_lookup_tables(void);
 
 // evaluate logic value by algorithm
-LogicValue evaluate_input_scan(SimGate* gate, SimGate* all_gates);
-LogicValue evaluate_lookup_table(SimGate* gate, SimGate* all_gates);
+LogicValue evaluate_input_scan(const Simulator* sim, int gate_id);
+LogicValue evaluate_lookup_table(const Simulator* sim, int gate_id);
+// the same, reading fanins with sim_get_state_shared
+LogicValue evaluate_input_scan_shared(const Simulator* sim, int gate_id);
+LogicValue evaluate_lookup_table_shared(const Simulator* sim, int gate_id);
 
 // scheduling
 void schedule_fanout(int gate_id, Simulator* sim);
 void schedule_gate(int gate_id, Simulator* sim);
 
 // simulation
-void simulate(Simulator* sim, int use_lookup_table);
+void simulate(Simulator* sim, SimIO* io, int use_lookup_table);
+void simulate_hybrid(Simulator* sim, SimIO* io, int use_lookup_table, double threshold);
+void simulate_parallel(Simulator* sim, SimIO* io, int use_lookup_table, int threads,
+                       ParallelMode mode);
 void print_state(Simulator* sim, int cycle);
+int level_order(Simulator* sim, int* order);
+long evaluate_events(Simulator* sim, int use_lookup_table);
+void init_sweep_plan(SweepPlan* plan, Simulator* sim, int use_lookup_table);
+long sweep_plan_run(SweepPlan* plan, Simulator* sim);
+void free_sweep_plan(SweepPlan* plan);
+
+// pattern-parallel simulation
+int pattern_words_supported(int words);
+void init_pattern_sim(PatternSim* ps, Simulator* sim, int words);
+void pattern_step(PatternSim* ps);
+void pattern_set_input(PatternSim* ps, int input, int lane, LogicValue v);
+LogicValue pattern_get(const PatternSim* ps, int gate_id, int lane);
+void simulate_patterns(Simulator* sim, SimIO* io, int words);
+void free_pattern_sim(PatternSim* ps);
+
+// bytecode simulation
+void init_bytecode_sim(BytecodeSim* bs, Simulator* sim);
+void bytecode_step(BytecodeSim* bs);
+void simulate_bytecode(Simulator* sim, SimIO* io);
+void free_bytecode_sim(BytecodeSim* bs);
+
+// multi-threaded event-driven simulation
+int parallel_default_threads(void);
+void init_parallel_sim(ParallelSim* ps, Simulator* sim, int threads, int use_lookup_table,
+                       ParallelMode mode);
+long parallel_events(ParallelSim* ps);
+void print_partition_report(const ParallelSim* ps);
+void free_parallel_sim(ParallelSim* ps);
+long partition_circuit(const Simulator* sim, int k, int* part);
+
+// compiled-code simulation (compiled_sim.c)
+int simulate_compiled(Simulator* sim, SimIO* io);
+
+// waveform tracing (vcd.c)
+int init_vcd_trace(VcdTrace* vt, Simulator* sim, const char* filename, const char* signals);
+void vcd_trace_cycle(VcdTrace* vt, int cycle);
+void vcd_trace_finish(VcdTrace* vt);
+void free_vcd_trace(VcdTrace* vt);
+
+// stimulus and responses (sim_io.c)
+void init_sim_io(SimIO* io, const Simulator* sim, const char* stimulus_file,
+                 const char* response_file, int options);
+int sim_io_next(SimIO* io, const uint8_t** values);
+void sim_io_prompt(SimIO* io);
+void sim_io_state(SimIO* io, Simulator* sim, int cycle);
+int sim_io_report(SimIO* io, int cycles, double cpu_time);
+void free_sim_io(SimIO* io);
 
 // cleanup
 void free_simulator(Simulator* sim);
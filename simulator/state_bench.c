@@ -0,0 +1,394 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "simulator.h"
+
+/*
+ * Evaluation benchmark. Builds a random combinational circuit (or loads
+ * a circuit file), then times full level-order sweeps with input scanning
+ * and with table lookup, and event-driven cycles, on random input vectors.
+ * Compile it once as is and once with -DSIM_PACKED_STATE (make bench) and
+ * run both on the same circuit to compare byte-per-signal and 2-bit packed
+ * state; raise the fan-in to exercise the wide lookup tables. Last, it
+ * replays the same sparse stimulus (one input flipped per cycle) through
+ * the serial event-driven pass and through the parallel passes at 1, 2,
+ * 4, ... threads, and with more partitions than the circuit has levels,
+ * and checks that they all end in the same state.
+ */
+
+#define BENCH_INPUTS 64
+#define BENCH_OUTPUTS 64
+#define SPARSE_FLIPS 1
+
+static uint64_t rng_state = 88172645463325252ULL;
+
+static uint64_t next_random(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static uint64_t align8(uint64_t offset) {
+    return (offset + 7) & ~(uint64_t)7;
+}
+
+// Writes a random circuit of gate_count gates in the binary circuit format,
+// each with 2 to max_fanin fanins (NOT has one). Fanins are drawn from all
+// earlier gates, so accesses are spread over the whole state array the way
+// they are in a large flattened netlist.
+static void write_random_circuit(const char* filename, int gate_count, int max_fanin) {
+    static const GateType kinds[] = { GATE_AND, GATE_NAND, GATE_OR, GATE_NOR, GATE_XOR, GATE_NOT };
+    int n = gate_count;
+
+    int32_t* fanin_offsets = (int32_t*)malloc((n + 1) * sizeof(int32_t));
+    int32_t* fanins = (int32_t*)malloc((size_t)max_fanin * n * sizeof(int32_t));
+    int32_t* fanout_offsets = (int32_t*)calloc(n + 2, sizeof(int32_t));
+    int32_t* fanouts = (int32_t*)malloc((size_t)max_fanin * n * sizeof(int32_t));
+    int32_t* fill = (int32_t*)malloc((n + 1) * sizeof(int32_t));
+    uint8_t* types = (uint8_t*)malloc(n);
+    uint8_t* flags = (uint8_t*)calloc(n, 1);
+    int32_t* levels = (int32_t*)malloc(n * sizeof(int32_t));
+    uint32_t* name_offsets = (uint32_t*)calloc(n, sizeof(uint32_t));
+    if (!fanin_offsets || !fanins || !fanout_offsets || !fanouts || !fill ||
+        !types || !flags || !levels || !name_offsets) {
+        exit(1);
+    }
+
+    int edges = 0;
+    int max_level = 0;
+    for (int i = 0; i < n; i++) {
+        fanin_offsets[i] = edges;
+        if (i < BENCH_INPUTS) {
+            types[i] = GATE_INPUT;
+            levels[i] = 0;
+            continue;
+        }
+        types[i] = kinds[next_random() % 6];
+        int count = (types[i] == GATE_NOT) ? 1 : 2 + (int)(next_random() % (max_fanin - 1));
+        int level = 0;
+        for (int k = 0; k < count; k++) {
+            int from = (int)(next_random() % i);
+            fanins[edges++] = from;
+            fanout_offsets[from + 1]++;
+            if (levels[from] + 1 > level) {
+                level = levels[from] + 1;
+            }
+        }
+        levels[i] = level;
+        if (level > max_level) {
+            max_level = level;
+        }
+        if (i >= n - BENCH_OUTPUTS) {
+            flags[i] = CIRCUIT_FLAG_OUTPUT;
+        }
+    }
+    fanin_offsets[n] = edges;
+
+    for (int i = 0; i < n; i++) {
+        fanout_offsets[i + 1] += fanout_offsets[i];
+        fill[i] = fanout_offsets[i];
+    }
+    for (int i = 0; i < n; i++) {
+        for (int e = fanin_offsets[i]; e < fanin_offsets[i + 1]; e++) {
+            fanouts[fill[fanins[e]]++] = i;
+        }
+    }
+
+    CircuitFileHeader h;
+    memset(&h, 0, sizeof(h));
+    h.magic = CIRCUIT_BIN_MAGIC;
+    h.version = CIRCUIT_BIN_VERSION;
+    h.gate_count = n;
+    h.input_count = BENCH_INPUTS;
+    h.output_count = BENCH_OUTPUTS;
+    h.dff_count = 0;
+    h.fanin_edges = edges;
+    h.fanout_edges = edges;
+    h.max_level = max_level;
+    h.names_size = 2;   // every gate is called "g"
+    h.fanin_offsets = align8(sizeof(h));
+    h.fanins = align8(h.fanin_offsets + (uint64_t)(n + 1) * sizeof(int32_t));
+    h.fanout_offsets = align8(h.fanins + (uint64_t)edges * sizeof(int32_t));
+    h.fanouts = align8(h.fanout_offsets + (uint64_t)(n + 1) * sizeof(int32_t));
+    h.types = align8(h.fanouts + (uint64_t)edges * sizeof(int32_t));
+    h.flags = align8(h.types + n);
+    h.levels = align8(h.flags + n);
+    h.name_offsets = align8(h.levels + (uint64_t)n * sizeof(int32_t));
+    h.names = align8(h.name_offsets + (uint64_t)n * sizeof(uint32_t));
+
+    size_t size = h.names + h.names_size;
+    char* image = (char*)calloc(size, 1);
+    if (!image) {
+        exit(1);
+    }
+    memcpy(image, &h, sizeof(h));
+    memcpy(image + h.fanin_offsets, fanin_offsets, (n + 1) * sizeof(int32_t));
+    memcpy(image + h.fanins, fanins, (size_t)edges * sizeof(int32_t));
+    memcpy(image + h.fanout_offsets, fanout_offsets, (n + 1) * sizeof(int32_t));
+    memcpy(image + h.fanouts, fanouts, (size_t)edges * sizeof(int32_t));
+    memcpy(image + h.types, types, n);
+    memcpy(image + h.flags, flags, n);
+    memcpy(image + h.levels, levels, (size_t)n * sizeof(int32_t));
+    memcpy(image + h.name_offsets, name_offsets, (size_t)n * sizeof(uint32_t));
+    memcpy(image + h.names, "g", 2);
+
+    FILE* fp = fopen(filename, "wb");
+    if (!fp || fwrite(image, 1, size, fp) != size || fclose(fp) != 0) {
+        fprintf(stderr, "Could not write %s\n", filename);
+        exit(1);
+    }
+
+    free(image);
+    free(fanin_offsets);
+    free(fanins);
+    free(fanout_offsets);
+    free(fanouts);
+    free(fill);
+    free(types);
+    free(flags);
+    free(levels);
+    free(name_offsets);
+}
+
+static double seconds_since(const struct timespec* start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+// random 0/1 on every input; returns how many changed
+static int apply_random_inputs(Simulator* sim, int schedule) {
+    int changed = 0;
+    for (int i = 0; i < sim->input_count; i++) {
+        int indx = sim->input_indices[i];
+        LogicValue v = (next_random() & 1) ? VALUE_1 : VALUE_0;
+        if (sim_get_state(sim, indx) != v) {
+            sim_set_state(sim, indx, v);
+            if (schedule) {
+                schedule_fanout(indx, sim);
+            }
+            changed++;
+        }
+    }
+    return changed;
+}
+
+// flips SPARSE_FLIPS random inputs and schedules their fanouts
+static void apply_sparse_inputs(Simulator* sim) {
+    for (int k = 0; k < SPARSE_FLIPS; k++) {
+        int indx = sim->input_indices[next_random() % sim->input_count];
+        sim_set_state(sim, indx, sim_get_state(sim, indx) == VALUE_0 ? VALUE_1 : VALUE_0);
+        schedule_fanout(indx, sim);
+    }
+}
+
+// 1, 2, 4, ... and then max_threads itself
+static int next_thread_count(int threads, int max_threads) {
+    if (threads < max_threads && threads * 2 > max_threads) {
+        return max_threads;
+    }
+    return threads * 2;
+}
+
+// Runs cycles sparse cycles from the state in start, serially (ps NULL) or
+// on ps. Leaves the final state in sim and returns the time.
+static double time_sparse(Simulator* sim, ParallelSim* ps, const SimStateWord* start,
+                          uint64_t seed, int cycles, long* events) {
+    size_t state_size = SIM_STATE_WORDS(sim->gate_count + 1) * sizeof(SimStateWord);
+    memcpy(sim->state, start, state_size);
+    rng_state = seed;
+    *events = 0;
+
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    for (int c = 0; c < cycles; c++) {
+        apply_sparse_inputs(sim);
+        *events += ps ? parallel_events(ps) : evaluate_events(sim, 0);
+    }
+    return seconds_since(&t);
+}
+
+// the serial sparse run every parallel one is checked against
+typedef struct SparseBaseline {
+    const SimStateWord* start_state;
+    const SimStateWord* serial_state;
+    size_t state_size;
+    uint64_t seed;
+    int cycles;
+    long events;
+    double serial_time;
+} SparseBaseline;
+
+// Replays the sparse run on threads threads in mode and prints its time,
+// flagging a final state or event count that differs from the serial run.
+static void time_parallel(Simulator* sim, const SparseBaseline* base, int threads, ParallelMode mode) {
+    static const char* mode_names[] = { "levels", "stealing", "partitioned" };
+
+    // partitions copy the state when they are built
+    memcpy(sim->state, base->start_state, base->state_size);
+    ParallelSim ps;
+    init_parallel_sim(&ps, sim, threads, 0, mode);
+    long events;
+    double t = time_sparse(sim, &ps, base->start_state, base->seed, base->cycles, &events);
+    int same = events == base->events && memcmp(sim->state, base->serial_state, base->state_size) == 0;
+    printf("  %-11s %2d threads: %8.3f s  %5.2fx%s", mode_names[mode], ps.thread_count, t,
+           base->serial_time / t, same ? "" : "  MISMATCH");
+    if (mode == PARALLEL_PARTITIONED) {
+        long total = 0, heaviest = 0;
+        for (int p = 0; p < ps.thread_count; p++) {
+            total += ps.parts[p].load;
+            if (ps.parts[p].load > heaviest) {
+                heaviest = ps.parts[p].load;
+            }
+        }
+        printf("  (cut %.2f%%, %d bands, heaviest part %.2fx)",
+               100.0 * ps.cut_edges / sim->fanin_start[sim->gate_count], ps.band_count,
+               (double)heaviest * ps.thread_count / total);
+    }
+    printf("\n");
+    free_parallel_sim(&ps);
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        printf("Usage: %s <circuit_file [cycles [max_threads]] | -g gates [cycles [max_fanin [max_threads]]]>\n",
+               argv[0]);
+        return 1;
+    }
+
+    int cycles = (argc >= 3) ? atoi(argv[2]) : 20;
+    int max_threads = (argc >= 4) ? atoi(argv[3]) : parallel_default_threads();
+    char temp_file[] = "/tmp/state_bench_XXXXXX";
+    const char* circuit_file = argv[1];
+
+    if (strcmp(argv[1], "-g") == 0) {
+        if (argc < 3) {
+            printf("Usage: %s -g gates [cycles] [max_fanin]\n", argv[0]);
+            return 1;
+        }
+        int gates = atoi(argv[2]);
+        cycles = (argc >= 4) ? atoi(argv[3]) : 20;
+        int max_fanin = (argc >= 5) ? atoi(argv[4]) : 2;
+        max_threads = (argc >= 6) ? atoi(argv[5]) : parallel_default_threads();
+        if (max_fanin < 2) {
+            max_fanin = 2;
+        }
+        if (gates <= BENCH_INPUTS + BENCH_OUTPUTS) {
+            fprintf(stderr, "Need more than %d gates\n", BENCH_INPUTS + BENCH_OUTPUTS);
+            return 1;
+        }
+        int fd = mkstemp(temp_file);
+        if (fd < 0) {
+            fprintf(stderr, "Could not create a temporary file\n");
+            return 1;
+        }
+        close(fd);
+        write_random_circuit(temp_file, gates, max_fanin);
+        circuit_file = temp_file;
+    }
+
+    Simulator sim;
+    init_simulator(&sim);
+    init_lookup_tables();
+    load_circuit_file(circuit_file, &sim);
+    if (circuit_file == temp_file) {
+        unlink(temp_file);
+    }
+
+    int* order = (int*)malloc((sim.gate_count + 1) * sizeof(int));
+    if (!order) {
+        exit(1);
+    }
+    int order_count = level_order(&sim, order);
+
+#ifdef SIM_PACKED_STATE
+    const char* layout = "packed 2-bit";
+#else
+    const char* layout = "byte";
+#endif
+    printf("Layout: %s, %d gates, %d levels, average fan-in %.2f, state %zu bytes\n",
+           layout, sim.gate_count, sim.max_level + 1,
+           order_count ? (double)sim.fanin_start[sim.gate_count] / order_count : 0.0,
+           SIM_STATE_WORDS(sim.gate_count + 1) * sizeof(SimStateWord));
+
+    // oblivious: every gate in level order, every cycle
+    struct timespec start;
+    for (int use_lookup_table = 0; use_lookup_table <= 1; use_lookup_table++) {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int c = 0; c < cycles; c++) {
+            apply_random_inputs(&sim, 0);
+            for (int i = 0; i < order_count; i++) {
+                LogicValue v = use_lookup_table ? evaluate_lookup_table(&sim, order[i])
+                                                : evaluate_input_scan(&sim, order[i]);
+                sim_set_state(&sim, order[i], v);
+            }
+        }
+        double sweep_time = seconds_since(&start);
+        printf("Sweep (%s, per gate): %8.3f s  %8.2f M gate evaluations/s\n",
+               use_lookup_table ? "table" : "scan ", sweep_time,
+               (double)order_count * cycles / sweep_time / 1e6);
+
+        // the same sweep as runs of one gate type (the hybrid simulator's path)
+        SweepPlan plan;
+        init_sweep_plan(&plan, &sim, use_lookup_table);
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int c = 0; c < cycles; c++) {
+            apply_random_inputs(&sim, 0);
+            sweep_plan_run(&plan, &sim);
+        }
+        sweep_time = seconds_since(&start);
+        printf("Sweep (%s, grouped):  %8.3f s  %8.2f M gate evaluations/s\n",
+               use_lookup_table ? "table" : "scan ", sweep_time,
+               (double)order_count * cycles / sweep_time / 1e6);
+        free_sweep_plan(&plan);
+    }
+
+    // event-driven: only gates whose fanins changed
+    long events = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int c = 0; c < cycles; c++) {
+        apply_random_inputs(&sim, 1);
+        events += evaluate_events(&sim, 0);
+    }
+    double event_time = seconds_since(&start);
+    printf("Events:                %8.3f s  %8.2f M fanout events/s\n", event_time,
+           (double)events / event_time / 1e6);
+
+    // sparse activity: serial, then each thread count and mode
+    size_t state_size = SIM_STATE_WORDS(sim.gate_count + 1) * sizeof(SimStateWord);
+    SimStateWord* start_state = (SimStateWord*)malloc(state_size);
+    SimStateWord* serial_state = (SimStateWord*)malloc(state_size);
+    if (!start_state || !serial_state) {
+        exit(1);
+    }
+    memcpy(start_state, sim.state, state_size);
+    uint64_t seed = rng_state;
+    int sparse_cycles = cycles * 10;
+
+    double serial_time = time_sparse(&sim, NULL, start_state, seed, sparse_cycles, &events);
+    memcpy(serial_state, sim.state, state_size);
+    printf("Sparse events, %d input flip per cycle, %.1f events per cycle:\n",
+           SPARSE_FLIPS, (double)events / sparse_cycles);
+    printf("  serial:                %8.3f s\n", serial_time);
+
+    SparseBaseline base = { start_state, serial_state, state_size, seed, sparse_cycles, events,
+                            serial_time };
+    for (int threads = 1; threads <= max_threads; threads = next_thread_count(threads, max_threads)) {
+        for (int mode = PARALLEL_LEVELS; mode <= PARALLEL_PARTITIONED; mode++) {
+            time_parallel(&sim, &base, threads, (ParallelMode)mode);
+        }
+    }
+    // more parts than levels: most levels of a part hold no gate
+    if (sim.max_level + 4 > max_threads && sim.max_level + 4 <= PARALLEL_MAX_THREADS) {
+        time_parallel(&sim, &base, sim.max_level + 4, PARALLEL_PARTITIONED);
+    }
+
+    free(start_state);
+    free(serial_state);
+    free(order);
+    free_simulator(&sim);
+    return 0;
+}
@@ -0,0 +1,365 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+#include <fnmatch.h>
+#include "simulator.h"
+
+/*
+ * VCD waveform output. The simulation thread only finds the changes: at
+ * every cycle it compares sim->state with its copy from the previous
+ * cycle eight bytes at a time, which skips unchanged stretches of the
+ * state in one compare whatever method produced it, and pushes
+ * (signal, value) entries for the traced signals that changed into a ring
+ * buffer. It is the only producer and the writer thread the only
+ * consumer, so the ring needs no locks: the producer publishes head, the
+ * writer publishes tail. The writer formats the entries and writes them.
+ * When the ring runs dry it sleeps on a condition variable, and the
+ * producer wakes it once a batch has built up, so the two threads do not
+ * trade a wakeup every cycle.
+ */
+
+#define VCD_TIME 0xFFFFFFFFu                // entry before a cycle number
+#define VCD_WAKE_BATCH (VCD_RING_SIZE / 8)
+#define VCD_OUT_BUFFER (1 << 20)
+
+#ifdef SIM_PACKED_STATE
+#define VCD_STATE_BITS 2                    // bits per signal in sim->state
+#else
+#define VCD_STATE_BITS 8
+#endif
+
+static void* vcd_alloc(size_t size) {
+    void* p = calloc(size ? size : 1, 1);
+    if (!p) {
+        exit(1);
+    }
+    return p;
+}
+
+// identifiers are base-94 over the printable characters '!' to '~'
+static void make_code(char* code, int index) {
+    int len = 0;
+    do {
+        code[len++] = (char)('!' + index % 94);
+        index /= 94;
+    } while (index > 0 && len < 4);
+    code[len] = '\0';
+}
+
+// comma-separated fnmatch patterns; NULL or empty matches every gate
+static int signal_selected(const char* name, const char* signals) {
+    if (!signals || !*signals) {
+        return 1;
+    }
+    char pattern[256];
+    while (*signals) {
+        size_t len = strcspn(signals, ",");
+        if (len > 0 && len < sizeof(pattern)) {
+            memcpy(pattern, signals, len);
+            pattern[len] = '\0';
+            if (fnmatch(pattern, name, 0) == 0) {
+                return 1;
+            }
+        }
+        signals += len + (signals[len] == ',');
+    }
+    return 0;
+}
+
+static void write_header(VcdTrace* vt, const int* gates) {
+    time_t now = time(NULL);
+    fprintf(vt->out, "$date\n    %s$end\n", ctime(&now));
+    fprintf(vt->out, "$version circuit_simulator $end\n");
+    fprintf(vt->out, "$comment one time unit per cycle $end\n");
+    fprintf(vt->out, "$timescale 1ns $end\n");
+    fprintf(vt->out, "$scope module circuit $end\n");
+    for (int i = 0; i < vt->signal_count; i++) {
+        const char* name = sim_gate_name(vt->sim, gates[i]);
+        if (*name) {
+            fprintf(vt->out, "$var wire 1 %s %s $end\n", vt->codes[i], name);
+        } else {
+            fprintf(vt->out, "$var wire 1 %s g%d $end\n", vt->codes[i], gates[i]);
+        }
+    }
+    fprintf(vt->out, "$upscope $end\n$enddefinitions $end\n");
+}
+
+// "#cycle\n", without going through printf for every cycle
+static size_t format_time(char* p, long cycle) {
+    char digits[24];
+    int n = 0;
+    do {
+        digits[n++] = (char)('0' + cycle % 10);
+        cycle /= 10;
+    } while (cycle > 0);
+    p[0] = '#';
+    for (int i = 0; i < n; i++) {
+        p[1 + i] = digits[n - 1 - i];
+    }
+    p[n + 1] = '\n';
+    return n + 2;
+}
+
+static void* vcd_writer(void* arg) {
+    VcdTrace* vt = (VcdTrace*)arg;
+    char* buf = (char*)vcd_alloc(VCD_OUT_BUFFER + 64);
+    size_t len = 0;
+    size_t tail = 0;
+    int dumpvars = 0;
+    long last_time = -1;
+    const size_t mask = VCD_RING_SIZE - 1;
+
+    for (;;) {
+        size_t head = __atomic_load_n(&vt->head, __ATOMIC_ACQUIRE);
+        if (head == tail) {
+            pthread_mutex_lock(&vt->lock);
+            __atomic_store_n(&vt->waiting, 1, __ATOMIC_SEQ_CST);
+            while (__atomic_load_n(&vt->head, __ATOMIC_SEQ_CST) == tail &&
+                   !__atomic_load_n(&vt->done, __ATOMIC_SEQ_CST)) {
+                pthread_cond_wait(&vt->wake, &vt->lock);
+            }
+            __atomic_store_n(&vt->waiting, 0, __ATOMIC_SEQ_CST);
+            pthread_mutex_unlock(&vt->lock);
+            if (__atomic_load_n(&vt->head, __ATOMIC_ACQUIRE) == tail) {
+                break;      // done and drained
+            }
+            continue;
+        }
+
+        while (tail != head) {
+            uint32_t e = vt->ring[tail++ & mask];
+            if (e == VCD_TIME) {
+                long cycle = vt->ring[tail++ & mask];
+                if (dumpvars) {
+                    memcpy(buf + len, "$end\n", 5);
+                    len += 5;
+                    dumpvars = 0;
+                }
+                if (cycle != last_time) {
+                    len += format_time(buf + len, cycle);
+                }
+                if (last_time < 0) {
+                    memcpy(buf + len, "$dumpvars\n", 10);
+                    len += 10;
+                    dumpvars = 1;
+                }
+                last_time = cycle;
+            } else {
+                buf[len++] = "01xx"[e & 3];
+                for (const char* c = vt->codes[e >> 2]; *c; c++) {
+                    buf[len++] = *c;
+                }
+                buf[len++] = '\n';
+            }
+            if (len > VCD_OUT_BUFFER) {
+                fwrite(buf, 1, len, vt->out);
+                len = 0;
+            }
+        }
+        __atomic_store_n(&vt->tail, tail, __ATOMIC_RELEASE);
+    }
+
+    if (dumpvars) {
+        memcpy(buf + len, "$end\n", 5);
+        len += 5;
+    }
+    fwrite(buf, 1, len, vt->out);
+    free(buf);
+    return NULL;
+}
+
+// Returns 0, or -1 if the file cannot be written or no gate matches
+// signals (comma-separated shell patterns, NULL for every gate).
+int init_vcd_trace(VcdTrace* vt, Simulator* sim, const char* filename, const char* signals) {
+    memset(vt, 0, sizeof(*vt));
+    vt->sim = sim;
+    vt->state_bytes = SIM_STATE_WORDS(sim->gate_count + 1) * sizeof(SimStateWord);
+
+    // one entry per signal field of the state, padding included
+    size_t fields = vt->state_bytes * 8 / VCD_STATE_BITS;
+    vt->trace_index = (int*)vcd_alloc(fields * sizeof(int));
+    int* gates = (int*)vcd_alloc(sim->gate_count * sizeof(int));
+    for (size_t i = 0; i < fields; i++) {
+        vt->trace_index[i] = -1;
+    }
+    for (int i = 0; i < sim->gate_count; i++) {
+        if (signal_selected(sim_gate_name(sim, i), signals)) {
+            vt->trace_index[i] = vt->signal_count;
+            gates[vt->signal_count++] = i;
+        }
+    }
+    if (vt->signal_count == 0) {
+        fprintf(stderr, "No signals match %s\n", signals);
+        free(gates);
+        free(vt->trace_index);
+        return -1;
+    }
+
+    vt->out = fopen(filename, "w");
+    if (!vt->out) {
+        fprintf(stderr, "Cannot open waveform file: %s\n", filename);
+        free(gates);
+        free(vt->trace_index);
+        return -1;
+    }
+
+    vt->codes = (char(*)[5])vcd_alloc(vt->signal_count * sizeof(*vt->codes));
+    for (int i = 0; i < vt->signal_count; i++) {
+        make_code(vt->codes[i], i);
+    }
+    write_header(vt, gates);
+    free(gates);
+
+    vt->prev = (SimStateWord*)vcd_alloc(vt->state_bytes);
+    vt->ring = (uint32_t*)vcd_alloc(VCD_RING_SIZE * sizeof(uint32_t));
+    pthread_mutex_init(&vt->lock, NULL);
+    pthread_cond_init(&vt->wake, NULL);
+    pthread_create(&vt->thread, NULL, vcd_writer, vt);
+    return 0;
+}
+
+// Makes the pushed entries visible and wakes a sleeping writer once a
+// batch is waiting. Clearing waiting here keeps the producer from
+// signalling again and again before the writer gets to run. The store and
+// load are not fenced against the writer going to sleep: a writer that
+// slept on a stale head is woken by a later publish, and the last one,
+// from vcd_trace_finish, always wakes it.
+static void publish(VcdTrace* vt, int force) {
+    __atomic_store_n(&vt->head, vt->head_local, __ATOMIC_RELEASE);
+    if (!__atomic_load_n(&vt->waiting, __ATOMIC_RELAXED)) {
+        return;
+    }
+    vt->tail_seen = __atomic_load_n(&vt->tail, __ATOMIC_ACQUIRE);
+    if (force || vt->head_local - vt->tail_seen >= VCD_WAKE_BATCH) {
+        pthread_mutex_lock(&vt->lock);
+        __atomic_store_n(&vt->waiting, 0, __ATOMIC_SEQ_CST);
+        pthread_cond_signal(&vt->wake);
+        pthread_mutex_unlock(&vt->lock);
+    }
+}
+
+// makes room for n entries, waiting for the writer if the ring is full
+static inline void reserve(VcdTrace* vt, size_t n) {
+    if (vt->head_local + n - vt->tail_seen <= VCD_RING_SIZE) {
+        return;
+    }
+    vt->tail_seen = __atomic_load_n(&vt->tail, __ATOMIC_ACQUIRE);
+    while (vt->head_local + n - vt->tail_seen > VCD_RING_SIZE) {
+        publish(vt, 1);
+        sched_yield();
+        vt->tail_seen = __atomic_load_n(&vt->tail, __ATOMIC_ACQUIRE);
+    }
+}
+
+static inline void push(VcdTrace* vt, uint32_t entry) {
+    reserve(vt, 1);
+    vt->ring[vt->head_local++ & (VCD_RING_SIZE - 1)] = entry;
+}
+
+// the pair is published together, so the writer never sees half of it
+static void push_time(VcdTrace* vt, int cycle) {
+    reserve(vt, 2);
+    vt->ring[vt->head_local++ & (VCD_RING_SIZE - 1)] = VCD_TIME;
+    vt->ring[vt->head_local++ & (VCD_RING_SIZE - 1)] = (uint32_t)cycle;
+}
+
+// diff holds the bits that changed in the 8 bytes of state at byte
+static void push_changes(VcdTrace* vt, size_t byte, uint64_t diff, uint64_t now,
+                         int cycle, int* marked) {
+    const uint64_t field = (VCD_STATE_BITS == 8) ? 0xFF : 3;
+    size_t first = byte * 8 / VCD_STATE_BITS;
+    while (diff) {
+        int shift = __builtin_ctzll(diff) / VCD_STATE_BITS * VCD_STATE_BITS;
+        diff &= ~(field << shift);
+        int index = vt->trace_index[first + shift / VCD_STATE_BITS];
+        if (index < 0) {
+            continue;
+        }
+        if (!*marked) {
+            push_time(vt, cycle);
+            *marked = 1;
+        }
+        push(vt, ((uint32_t)index << 2) | (uint32_t)((now >> shift) & 3));
+        vt->changes++;
+    }
+}
+
+// Records the traced signals that changed since the last call; the first
+// call records all of them.
+void vcd_trace_cycle(VcdTrace* vt, int cycle) {
+    Simulator* sim = vt->sim;
+    vt->cycle = cycle;
+
+    if (!vt->started) {
+        vt->started = 1;
+        memcpy(vt->prev, sim->state, vt->state_bytes);
+        push_time(vt, cycle);
+        for (int i = 0; i < sim->gate_count; i++) {
+            if (vt->trace_index[i] >= 0) {
+                push(vt, ((uint32_t)vt->trace_index[i] << 2) | sim_get_state(sim, i));
+            }
+        }
+        publish(vt, 0);
+        return;
+    }
+
+    const unsigned char* cur = (const unsigned char*)sim->state;
+    unsigned char* prev = (unsigned char*)vt->prev;
+    size_t full = vt->state_bytes & ~(size_t)7;
+    int marked = 0;
+    for (size_t b = 0; b < full; b += 8) {
+        uint64_t now, before;
+        memcpy(&now, cur + b, 8);
+        memcpy(&before, prev + b, 8);
+        if (now != before) {
+            memcpy(prev + b, &now, 8);
+            push_changes(vt, b, now ^ before, now, cycle, &marked);
+        }
+    }
+    if (full < vt->state_bytes) {
+        uint64_t now = 0, before = 0;
+        memcpy(&now, cur + full, vt->state_bytes - full);
+        memcpy(&before, prev + full, vt->state_bytes - full);
+        if (now != before) {
+            memcpy(prev + full, &now, vt->state_bytes - full);
+            push_changes(vt, full, now ^ before, now, cycle, &marked);
+        }
+    }
+    publish(vt, 0);
+}
+
+// Marks the end time, lets the writer drain the ring and waits for it.
+void vcd_trace_finish(VcdTrace* vt) {
+    if (vt->finished) {
+        return;
+    }
+    vt->finished = 1;
+    if (vt->started) {
+        push_time(vt, vt->cycle);
+    }
+    publish(vt, 1);
+    pthread_mutex_lock(&vt->lock);
+    __atomic_store_n(&vt->done, 1, __ATOMIC_SEQ_CST);
+    pthread_cond_signal(&vt->wake);
+    pthread_mutex_unlock(&vt->lock);
+    pthread_join(vt->thread, NULL);
+    fflush(vt->out);
+}
+
+void free_vcd_trace(VcdTrace* vt) {
+    vcd_trace_finish(vt);
+    fclose(vt->out);
+    pthread_mutex_destroy(&vt->lock);
+    pthread_cond_destroy(&vt->wake);
+    free(vt->trace_index);
+    free(vt->codes);
+    free(vt->prev);
+    free(vt->ring);
+    vt->trace_index = NULL;
+    vt->codes = NULL;
+    vt->prev = NULL;
+    vt->ring = NULL;
+    vt->out = NULL;
+}